@@ -33,33 +33,37 @@ public:
 
     bool hit(const Ray& r, Interval rayT) const
     {
+        // Slab test with the ray's precomputed reciprocal direction. The sign of the direction
+        // picks the near and far plane of each slab, so no per-axis swap is needed. When the ray
+        // runs inside a slab plane, 0 * inf yields NaN; slabMax()/slabMin() keep the running
+        // value in that case, so a NaN never decides the outcome.
+
         const Point& rayOrig = r.origin();
-        const glm::dvec3& rayDir = r.direction();
-
-        for (int axis = 0; axis < 3; axis++)
-        {
-            const Interval& ax = axisInterval(axis);
-            const double adinv = 1.0 / rayDir[axis];
-
-            auto t0 = (ax.min - rayOrig[axis]) * adinv;
-            auto t1 = (ax.max - rayOrig[axis]) * adinv;
-
-            if (t0 < t1)
-            {
-                if (t0 > rayT.min) rayT.min = t0;
-                if (t1 < rayT.max) rayT.max = t1;
-            }
-            else
-            {
-                if (t1 > rayT.min) rayT.min = t1;
-                if (t0 < rayT.max) rayT.max = t0;
-            }
-
-            if (rayT.max <= rayT.min) return false;
-        }
-        return true;
+        const glm::dvec3& invDir = r.invDirection();
+
+        auto tMin = rayT.min;
+        auto tMax = rayT.max;
+
+        tMin = slabMax((slabBound(x, r.dirIsNegative(0)) - rayOrig.x) * invDir.x, tMin);
+        tMax = slabMin((slabBound(x, !r.dirIsNegative(0)) - rayOrig.x) * invDir.x, tMax);
+        tMin = slabMax((slabBound(y, r.dirIsNegative(1)) - rayOrig.y) * invDir.y, tMin);
+        tMax = slabMin((slabBound(y, !r.dirIsNegative(1)) - rayOrig.y) * invDir.y, tMax);
+        tMin = slabMax((slabBound(z, r.dirIsNegative(2)) - rayOrig.z) * invDir.z, tMin);
+        tMax = slabMin((slabBound(z, !r.dirIsNegative(2)) - rayOrig.z) * invDir.z, tMax);
+
+        return tMin < tMax;
+    }
+
+    double surfaceArea() const
+    {
+        // Returns the surface area of the box, 0 for an empty box.
+        if (x.size() < 0 || y.size() < 0 || z.size() < 0)
+            return 0;
+        return 2 * (x.size() * y.size() + y.size() * z.size() + z.size() * x.size());
     }
 
+    Point centroid() const { return Point(0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max)); }
+
     int longestAxis() const
     {
         // Returns the index of the longest axis of the bounding box.
@@ -71,6 +75,12 @@ public:
     static const Aabb empty, universe;
 
 private:
+    static double slabBound(const Interval& slab, bool upper) { return upper ? slab.max : slab.min; }
+
+    // Return the running value b when t is NaN.
+    static double slabMax(double t, double b) { return t > b ? t : b; }
+    static double slabMin(double t, double b) { return t < b ? t : b; }
+
     void padToMinimums()
     {
         // Adjust the AABB so that no side is narrower than some delta, padding if necessary.
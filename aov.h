@@ -0,0 +1,121 @@
+#ifndef _AOV_H_
+#define _AOV_H_
+
+#include "denoiser.h"
+#include "framebuffer.h"
+#include "image_writer.h"
+#include "resource_table.h"
+
+#include <string>
+#include <vector>
+
+// Arbitrary output variables: what the camera rays of the beauty pass saw at their first hit,
+// gathered while rendering and written as float images next to the image itself.
+
+struct AovSample
+{
+    // The first hit of one camera ray.
+
+    bool hit = false;                        // False if the ray escaped
+    double depth = 0;                        // Distance from the camera
+    glm::dvec3 normal = glm::dvec3(0, 0, 0); // Surface normal, facing the ray
+    Color albedo = Color(0, 0, 0);           // Material::baseColor() at the hit
+    MaterialId material = 0;                 // Material table ID
+    uint32_t primitive = 0;                  // Primitive index within the hit object (the triangle of a mesh, else 0)
+};
+
+struct AovStats
+{
+    // Running sums of the first hits of one pixel. Colors and geometry are averaged over the
+    // samples; IDs cannot be averaged and come from the first sample that hit something.
+
+    Color albedoSum = Color(0, 0, 0);
+    glm::dvec3 normalSum = glm::dvec3(0, 0, 0);
+    double depthSum = 0;
+    int hits = 0;
+    int count = 0;
+    MaterialId material = 0;
+    uint32_t primitive = 0;
+
+    void add(const AovSample& sample)
+    {
+        count++;
+        if (!sample.hit)
+            return;
+
+        if (hits == 0)
+        {
+            material = sample.material;
+            primitive = sample.primitive;
+        }
+        albedoSum += sample.albedo;
+        normalSum += sample.normal;
+        depthSum += sample.depth;
+        hits++;
+    }
+};
+
+inline FeatureBuffers aovFeatures(const std::vector<AovStats>& aovs, int width, int height)
+{
+    // Resolves the sums into per pixel averages. Escaped rays count as black albedo; normals and
+    // depth are averaged over the rays that hit, and stay 0 where none did.
+    FeatureBuffers features;
+    features.resize(width, height);
+
+    for (size_t index = 0; index < aovs.size(); index++)
+    {
+        const auto& aov = aovs[index];
+        if (aov.count > 0)
+            features.albedo[index] = aov.albedoSum / double(aov.count);
+        if (aov.hits > 0)
+        {
+            auto length = glm::length(aov.normalSum);
+            features.normal[index] = length > 0 ? aov.normalSum / length : glm::dvec3(0, 0, 0);
+            features.depth[index] = aov.depthSum / aov.hits;
+        }
+    }
+    return features;
+}
+
+inline bool writeAovs(const std::string& prefix, const std::vector<AovStats>& aovs, const std::vector<PixelStats>& pixels, int width, int height)
+{
+    // Writes PREFIX.NAME.pfm for every output variable:
+    //   depth     distance to the first hit (0 where every ray escaped)
+    //   normal    average first hit normal, unit length
+    //   albedo    average first hit base color
+    //   id        material table ID in red, primitive index in green, -1 for both where nothing was hit
+    //   samples   samples taken by the pixel
+    //   variance  variance of the pixel's mean luminance, estimated from its samples
+    // Single values are repeated in all three channels.
+
+    auto features = aovFeatures(aovs, width, height);
+    Framebuffer depth(width, height), normal(width, height), albedo(width, height);
+    Framebuffer id(width, height), samples(width, height), variance(width, height);
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            auto index = size_t(y) * width + x;
+            const auto& aov = aovs[index];
+
+            depth.set(x, y, Color(features.depth[index]));
+            normal.set(x, y, features.normal[index]);
+            albedo.set(x, y, features.albedo[index]);
+            id.set(x, y, aov.hits > 0 ? Color(aov.material, aov.primitive, 0) : Color(-1, -1, 0));
+            samples.set(x, y, Color(pixels[index].count));
+            variance.set(x, y, Color(pixels[index].meanVariance()));
+        }
+    }
+
+    bool ok = true;
+    ok = writeImage(depth, ImageFormat::Pfm, prefix + ".depth.pfm") && ok;
+    ok = writeImage(normal, ImageFormat::Pfm, prefix + ".normal.pfm") && ok;
+    ok = writeImage(albedo, ImageFormat::Pfm, prefix + ".albedo.pfm") && ok;
+    ok = writeImage(id, ImageFormat::Pfm, prefix + ".id.pfm") && ok;
+    ok = writeImage(samples, ImageFormat::Pfm, prefix + ".samples.pfm") && ok;
+    ok = writeImage(variance, ImageFormat::Pfm, prefix + ".variance.pfm") && ok;
+    return ok;
+}
+
+#endif//_AOV_H_
@@ -4,30 +4,293 @@
 #include "aabb.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "thread_pool.h"
 
-#include <algorithm> // std::sort()
+#include <algorithm> // std::nth_element(), std::partition()
+#include <thread>
+#include <vector>
+
+enum class BvhSplitMethod
+{
+    Median, // Sort by box minimum along the longest axis and split the span in half
+    Sah     // Binned surface area heuristic
+};
+
+struct BvhBuildOptions
+{
+    BvhSplitMethod method = BvhSplitMethod::Median; // How each node divides its objects
+    int binCount = 12;                              // SAH: centroid bins evaluated per node
+    double traversalCost = 1.0;                     // SAH: cost of visiting one node
+    double intersectionCost = 1.0;                  // SAH: cost of intersecting one object
+    int maxLeafSize = 4;                            // SAH: most objects a leaf may hold
+    int buildThreads = 0;                           // Threads used to build (0 = all hardware threads, 1 = serial)
+    size_t parallelMinObjects = 4096;               // Smallest span that is split across threads
+};
+
+inline int bvhBuildThreads(const BvhBuildOptions& options)
+{
+    return options.buildThreads > 0 ? options.buildThreads : ThreadPool::hardwareThreadCount();
+}
+
+template <typename Iterator, typename Fn>
+void forEachChunk(Iterator first, Iterator last, int threads, Fn&& fn)
+{
+    // Splits [first, last) into one contiguous chunk per thread and runs fn(chunkFirst,
+    // chunkLast, chunkIndex) on them in parallel.
+    auto count = size_t(last - first);
+    ThreadPool(threads).parallelFor(size_t(threads), [&](size_t chunk, int) {
+        fn(first + count * chunk / threads, first + count * (chunk + 1) / threads, chunk);
+    });
+}
+
+template <typename Iterator, typename BoundsOf>
+Iterator sahPartition(Iterator first, Iterator last, const Aabb& bounds, BoundsOf boundsOf, const BvhBuildOptions& options, int threads = 1,
+                      int* splitAxis = nullptr)
+{
+    // Partitions [first, last) at the cheapest of the binCount - 1 candidate planes along the
+    // longest axis of the object centroids and returns the split point. Returns last if keeping
+    // the objects together in a leaf is cheaper than any split. boundsOf(*it) gives the bounding
+    // box of an element, and splitAxis, if given, receives the axis the planes lie across. Large
+    // spans are scanned by up to threads threads; bounds and counts merge exactly, so the split
+    // does not depend on the thread count.
+
+    auto count = size_t(last - first);
+    auto leafCost = options.intersectionCost * count;
+    if (count < options.parallelMinObjects)
+        threads = 1;
+
+    auto centroidBoundsOf = [&](Iterator chunkFirst, Iterator chunkLast) {
+        Aabb centroids = Aabb::empty;
+        for (auto it = chunkFirst; it != chunkLast; ++it)
+        {
+            auto c = boundsOf(*it).centroid();
+            centroids = Aabb(centroids, Aabb(Interval(c.x, c.x), Interval(c.y, c.y), Interval(c.z, c.z)));
+        }
+        return centroids;
+    };
+
+    Aabb centroidBounds = Aabb::empty;
+    if (threads > 1)
+    {
+        std::vector<Aabb> partial(threads, Aabb::empty);
+        forEachChunk(first, last, threads, [&](Iterator f, Iterator l, size_t chunk) { partial[chunk] = centroidBoundsOf(f, l); });
+        for (const auto& box : partial)
+            centroidBounds = Aabb(centroidBounds, box);
+    }
+    else
+    {
+        centroidBounds = centroidBoundsOf(first, last);
+    }
+
+    int axis = centroidBounds.longestAxis();
+    const Interval& extent = centroidBounds.axisInterval(axis);
+    if (splitAxis != nullptr)
+        *splitAxis = axis;
+
+    if (extent.size() <= 0)
+    {
+        // All centroids coincide, so no plane separates them. Halve the span if it is too large.
+        if (count <= size_t(options.maxLeafSize))
+            return last;
+        return first + count / 2;
+    }
+
+    struct Bin
+    {
+        Aabb bounds = Aabb::empty;
+        size_t count = 0;
+    };
+
+    int binCount = std::max(2, options.binCount);
+    std::vector<Bin> bins(binCount);
+
+    auto binOf = [&](const Aabb& box) {
+        auto b = int(binCount * (box.centroid()[axis] - extent.min) / extent.size());
+        return std::min(b, binCount - 1);
+    };
+
+    auto fillBins = [&](Iterator chunkFirst, Iterator chunkLast, std::vector<Bin>& out) {
+        for (auto it = chunkFirst; it != chunkLast; ++it)
+        {
+            auto box = boundsOf(*it);
+            auto& bin = out[binOf(box)];
+            bin.bounds = Aabb(bin.bounds, box);
+            bin.count++;
+        }
+    };
+
+    if (threads > 1)
+    {
+        std::vector<std::vector<Bin>> partial(threads, std::vector<Bin>(binCount));
+        forEachChunk(first, last, threads, [&](Iterator f, Iterator l, size_t chunk) { fillBins(f, l, partial[chunk]); });
+        for (const auto& chunkBins : partial)
+        {
+            for (int b = 0; b < binCount; b++)
+            {
+                bins[b].bounds = Aabb(bins[b].bounds, chunkBins[b].bounds);
+                bins[b].count += chunkBins[b].count;
+            }
+        }
+    }
+    else
+    {
+        fillBins(first, last, bins);
+    }
+
+    // Sweep from the right to get the area and count of everything above each plane, then from
+    // the left to price each split.
+    std::vector<double> rightArea(binCount);
+    std::vector<size_t> rightCount(binCount);
+    Aabb above = Aabb::empty;
+    size_t aboveCount = 0;
+    for (int b = binCount - 1; b > 0; b--)
+    {
+        above = Aabb(above, bins[b].bounds);
+        aboveCount += bins[b].count;
+        rightArea[b] = above.surfaceArea();
+        rightCount[b] = aboveCount;
+    }
+
+    auto invArea = 1.0 / std::max(bounds.surfaceArea(), 1e-12);
+    double bestCost = INF;
+    int bestPlane = 1;
+    Aabb below = Aabb::empty;
+    size_t belowCount = 0;
+    for (int plane = 1; plane < binCount; plane++)
+    {
+        below = Aabb(below, bins[plane - 1].bounds);
+        belowCount += bins[plane - 1].count;
+        if (belowCount == 0 || rightCount[plane] == 0)
+            continue;
+
+        auto cost = options.traversalCost +
+                    options.intersectionCost * invArea * (belowCount * below.surfaceArea() + rightCount[plane] * rightArea[plane]);
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            bestPlane = plane;
+        }
+    }
+
+    if (count <= size_t(options.maxLeafSize) && bestCost >= leafCost)
+        return last;
+
+    auto mid = std::partition(first, last, [&](const auto& element) { return binOf(boundsOf(element)) < bestPlane; });
+    if (mid == first || mid == last)
+        mid = first + count / 2;
+    return mid;
+}
 
 class BvhNode : public Hittable
 {
 public:
-    BvhNode(HittableList list) : BvhNode(list.objects, 0, list.objects.size())
+    BvhNode(HittableList list, const BvhBuildOptions& options = BvhBuildOptions())
     {
         // There's a C++ subtlety here. This constructor (without span indices) creates an
         // implicit copy of the hittable list, which we will modify. The lifetime of the copied
         // list only extends until this constructor exits. That's OK, because we only need to
         // persist the resulting bounding volume hierarchy.
+
+        Timer buildTimer;
+        build(list.objects, 0, list.objects.size(), options, bvhBuildThreads(options));
+
+        std::clog << "BVH over " << list.objects.size() << " objects (" << (options.method == BvhSplitMethod::Sah ? "SAH" : "median")
+                  << " split) built in " << buildTimer.seconds() << " s, SAH cost " << sahCost(options) << '\n';
+    }
+
+    BvhNode(std::vector<shared_ptr<Hittable>>& objects, size_t start, size_t end, const BvhBuildOptions& options = BvhBuildOptions(),
+            int threads = 1)
+    {
+        build(objects, start, end, options, threads);
+    }
+
+    bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+    {
+        if (!bbox.hit(r, rayT))
+            return false;
+
+        if (!leafObjects.empty())
+        {
+            bool hitAnything = false;
+            for (const auto& object : leafObjects)
+            {
+                if (object->hit(r, rayT, rec))
+                {
+                    hitAnything = true;
+                    rayT.max = rec.t;
+                }
+            }
+            return hitAnything;
+        }
+
+        bool hitLeft = left->hit(r, rayT, rec);
+        bool hitRight = right->hit(r, Interval(rayT.min, hitLeft ? rec.t : rayT.max), rec);
+
+        return hitLeft || hitRight;
     }
 
-    BvhNode(std::vector<shared_ptr<Hittable>>& objects, size_t start, size_t end)
+    bool occluded(const Ray& r, Interval rayT) const override
+    {
+        if (!bbox.hit(r, rayT))
+            return false;
+
+        if (!leafObjects.empty())
+        {
+            for (const auto& object : leafObjects)
+                if (object->occluded(r, rayT))
+                    return true;
+            return false;
+        }
+
+        return left->occluded(r, rayT) || right->occluded(r, rayT);
+    }
+
+    Aabb boundingBox() const override { return bbox; }
+
+    double sahCost(const BvhBuildOptions& options = BvhBuildOptions()) const
+    {
+        // Returns the expected cost of a ray that hits this node's box: the traversal cost plus
+        // the cost of each child weighted by the chance, by surface area, that the ray hits it.
+        // Objects that are not BVH nodes count as one intersection.
+
+        if (!leafObjects.empty())
+            return options.intersectionCost * leafObjects.size();
+        if (left == right)
+            return options.intersectionCost;
+
+        auto invArea = 1.0 / std::max(bbox.surfaceArea(), 1e-12);
+        return options.traversalCost + invArea * (left->boundingBox().surfaceArea() * childCost(left, options) +
+                                                  right->boundingBox().surfaceArea() * childCost(right, options));
+    }
+
+private:
+    shared_ptr<Hittable> left;
+    shared_ptr<Hittable> right;
+    std::vector<shared_ptr<Hittable>> leafObjects; // Objects of a leaf made by the SAH builder
+    Aabb bbox;
+
+    void build(std::vector<shared_ptr<Hittable>>& objects, size_t start, size_t end, const BvhBuildOptions& options, int threads)
     {
         // Build the bounding box of the span of source objects.
         bbox = Aabb::empty;
         for (size_t objectIndex = start; objectIndex < end; objectIndex++)
             bbox = Aabb(bbox, objects[objectIndex]->boundingBox());
 
-        int axis = bbox.longestAxis();
-        auto comparator = (axis == 0) ? boxXcompare : (axis == 1) ? boxYcompare : boxZcompare;
         size_t objectSpan = end - start;
+
+        if (options.method == BvhSplitMethod::Sah)
+        {
+            auto first = std::begin(objects) + start;
+            auto last = std::begin(objects) + end;
+            auto split = objectSpan == 1 ? last : sahPartition(first, last, bbox, boundsOf, options, threads);
+
+            if (split == last)
+                leafObjects.assign(first, last);
+            else
+                buildChildren(objects, start, start + size_t(split - first), end, options, threads);
+            return;
+        }
+
         if (objectSpan == 1)
         {
             left = right = objects[start];
@@ -39,44 +302,54 @@ public:
         }
         else
         {
-            std::sort(std::begin(objects) + start, std::begin(objects) + end, comparator);
-
+            // Only the membership of the two halves matters, so a partial sort around the middle
+            // element does the job of a full sort.
+            int axis = bbox.longestAxis();
+            auto comparator = (axis == 0) ? boxXcompare : (axis == 1) ? boxYcompare : boxZcompare;
             auto mid = start + objectSpan / 2;
-            left = make_shared<BvhNode>(objects, start, mid);
-            right = make_shared<BvhNode>(objects, mid, end);
+            std::nth_element(std::begin(objects) + start, std::begin(objects) + mid, std::begin(objects) + end, comparator);
+
+            buildChildren(objects, start, mid, end, options, threads);
         }
     }
 
-    bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+    void buildChildren(std::vector<shared_ptr<Hittable>>& objects, size_t start, size_t mid, size_t end, const BvhBuildOptions& options,
+                       int threads)
     {
-        if (!bbox.hit(r, rayT))
-            return false;
-
-        bool hitLeft = left->hit(r, rayT, rec);
-        bool hitRight = right->hit(r, Interval(rayT.min, hitLeft ? rec.t : rayT.max), rec);
+        // The two subtrees cover disjoint spans of objects, so a large enough node builds its
+        // left subtree on a new thread, which gets half of this node's thread budget.
+        if (threads > 1 && end - start >= options.parallelMinObjects)
+        {
+            std::thread leftBuilder([&] { left = make_shared<BvhNode>(objects, start, mid, options, threads / 2); });
+            right = make_shared<BvhNode>(objects, mid, end, options, threads - threads / 2);
+            leftBuilder.join();
+            return;
+        }
 
-        return hitLeft || hitRight;
+        left = make_shared<BvhNode>(objects, start, mid, options);
+        right = make_shared<BvhNode>(objects, mid, end, options);
     }
 
-    Aabb boundingBox() const override { return bbox; }
+    static Aabb boundsOf(const shared_ptr<Hittable>& object) { return object->boundingBox(); }
 
-private:
-    shared_ptr<Hittable> left;
-    shared_ptr<Hittable> right;
-    Aabb bbox;
+    static double childCost(const shared_ptr<Hittable>& child, const BvhBuildOptions& options)
+    {
+        auto node = dynamic_cast<const BvhNode*>(child.get());
+        return node ? node->sahCost(options) : options.intersectionCost;
+    }
 
-    static bool box_compare(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b, int axisIndex)
+    static bool box_compare(const shared_ptr<Hittable>& a, const shared_ptr<Hittable>& b, int axisIndex)
     {
         auto aAxisInterval = a->boundingBox().axisInterval(axisIndex);
         auto bAxisInterval = b->boundingBox().axisInterval(axisIndex);
         return aAxisInterval.min < bAxisInterval.min;
     }
 
-    static bool boxXcompare(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b) { return box_compare(a, b, 0); }
+    static bool boxXcompare(const shared_ptr<Hittable>& a, const shared_ptr<Hittable>& b) { return box_compare(a, b, 0); }
 
-    static bool boxYcompare(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b) { return box_compare(a, b, 1); }
+    static bool boxYcompare(const shared_ptr<Hittable>& a, const shared_ptr<Hittable>& b) { return box_compare(a, b, 1); }
 
-    static bool boxZcompare(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b) { return box_compare(a, b, 2); }
+    static bool boxZcompare(const shared_ptr<Hittable>& a, const shared_ptr<Hittable>& b) { return box_compare(a, b, 2); }
 };
 
-#endif//_BVH_H_
\ No newline at end of file
+#endif//_BVH_H_
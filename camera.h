@@ -1,8 +1,19 @@
 #ifndef _CAMERA_H_
 #define _CAMERA_H_
 
+#include "aov.h"
+#include "checkpoint.h"
+#include "denoiser.h"
+#include "framebuffer.h"
 #include "hittable.h"
+#include "hittable_list.h"
+#include "image_writer.h"
 #include "material.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 class Camera
 {
@@ -22,48 +33,144 @@ public:
     double defocusAngle = 0; // Variation angle of rays through each pixel
     double focusDist = 10;   // Distance from camera lookFrom point to plane of perfect focus
 
-    void render(const Hittable& world)
+    int threadCount = 0; // Number of render threads (0 uses every hardware thread)
+    int tileSize = 32;   // Edge length in pixels of the square tiles handed out to render threads
+    uint64_t seed = 0;   // Seed of the per-pixel random sequences; equal seeds give identical images
+
+    bool adaptiveSampling = false;   // Stop converged pixels early and spend their samples on noisy ones
+    int adaptiveMinSamples = 16;     // Samples every pixel takes before its noise is first estimated (at least 2)
+    double adaptiveThreshold = 0.01; // Accepted 95% confidence error of a pixel, in display units [0,1]
+    int adaptiveMaxSamples = 0;      // Sample cap of a single pixel (0 = 4 * samplesPerPixel)
+
+    int rouletteDepth = 3;     // Path segments traced before Russian roulette may end a path (negative disables it)
+    bool sampleLights = false; // Also sample the lights directly at diffuse hits (next-event estimation)
+
+    bool denoise = false;       // Filter the finished image with the feature guided denoiser (denoiser.h)
+    int denoiseIterations = 5;  // Denoiser passes; each doubles the reach of the filter
+    int featureSamples = 4;     // Camera rays per pixel that find the albedo, normal and depth the denoiser follows
+
+    ImageFormat outputFormat = ImageFormat::Ppm; // Encoding of the output image (PpmAscii for the plain text P3)
+    std::string outputPath;                      // Output image file (empty writes to std::cout)
+    std::string aovPath;                         // Prefix of the AOV images, PREFIX.depth.pfm etc. (empty writes none; see aov.h)
+
+    std::string checkpointPath;      // File the in-progress render is saved to (empty disables checkpoints)
+    double checkpointInterval = 600; // Minimum number of seconds between two checkpoints
+    int checkpointPassSamples = 16;  // Samples per pixel rendered between two chances to checkpoint
+    bool resume = false;             // Continue from the checkpoint at checkpointPath, if there is a matching one
+    uint64_t sceneHash = 0;          // Identifies the scene description in checkpoints (set by the scene loader)
+
+    void render(const Hittable& world, const HittableList& lights = HittableList())
     {
+        // lights lists the emissive objects of world that light sampling may pick; see rayColor().
         initialize();
 
-        std::cout << "P3\n" << imageWidth << ' ' << imageHeight << "\n255\n";
-
-        for (int j = 0; j < imageHeight; j++)
+        ThreadPool pool(threadCount);
+        std::clog << "Rendering on " << pool.size() << " threads\n";
+
+        pixels.assign(size_t(imageWidth) * imageHeight, PixelStats());
+        aovs.assign(aovPath.empty() ? 0 : pixels.size(), AovStats());
+        if (resume && !checkpointPath.empty() && loadCheckpoint(checkpointPath, checkpointHeader(), pixels, aovs))
+            std::clog << "Resumed from checkpoint '" << checkpointPath << "'\n";
+        lastCheckpoint = std::chrono::steady_clock::now();
+        pathCount = 0;
+        pathSegments = 0;
+
+        // Every pixel is first sampled up to its target count. In adaptive mode that is only a
+        // first estimate, refined afterwards by further passes over the noisy pixels. Samples
+        // already restored from a checkpoint are skipped.
+        if (adaptiveSampling)
         {
-            std::clog << "\rScanlines remaining: " << (imageHeight - j) << ' ' << std::flush;
-            for (int i = 0; i < imageWidth; i++)
+            std::vector<int> targets(pixels.size(), std::min(adaptiveMinSamples, samplesPerPixel));
+            renderPass(world, lights, pool, targets);
+            checkpointIfDue();
+            refineNoisyPixels(world, lights, pool, targets);
+        }
+        else
+        {
+            // With checkpoints enabled the samples are taken in several passes over the image.
+            int passSamples = checkpointPath.empty() ? samplesPerPixel : std::max(1, checkpointPassSamples);
+            for (int passEnd = passSamples;; passEnd += passSamples)
             {
-                Color pixel_color(0, 0, 0);
-                for (int sample = 0; sample < samplesPerPixel; sample++)
-                {
-                    Ray r = getRay(i, j);
-                    pixel_color += rayColor(r, maxDepth, world);
-                }
-                writeColor(std::cout, pixelSamplesScale * pixel_color);
+                std::vector<int> targets(pixels.size(), std::min(passEnd, samplesPerPixel));
+                renderPass(world, lights, pool, targets);
+                if (passEnd >= samplesPerPixel)
+                    break;
+                checkpointIfDue();
             }
         }
 
+        if (!checkpointPath.empty())
+            saveCheckpoint(checkpointPath, checkpointHeader(), pixels, aovs);
+
         std::clog << "\rDone.                 \n";
+        reportSampleCounts();
+
+        // Resolve the sample sums into linear radiance and encode the finished frame in one go.
+        image = Framebuffer(imageWidth, imageHeight);
+        for (int j = 0; j < imageHeight; j++)
+            for (int i = 0; i < imageWidth; i++)
+                image.set(i, j, pixels[size_t(j) * imageWidth + i].mean());
+
+        if (denoise)
+        {
+            Timer denoiseTimer;
+            auto features = renderFeatures(world, pool);
+
+            std::vector<double> variance(pixels.size());
+            for (size_t index = 0; index < pixels.size(); index++)
+                variance[index] = pixels[index].meanVariance();
+
+            Denoiser denoiser;
+            denoiser.iterations = denoiseIterations;
+            denoiser.tileSize = tileSize;
+            image = denoiser.apply(image, variance, features, pool);
+            std::clog << "Denoised in " << denoiseTimer.seconds() << " s\n";
+        }
+
+        writeImage(image, outputFormat, outputPath);
+
+        if (!aovPath.empty())
+            writeAovs(aovPath, aovs, pixels, imageWidth, imageHeight);
+    }
+
+    const Framebuffer& renderedImage() const { return image; }
+
+    int sampleCount(int i, int j) const
+    {
+        // Returns the number of samples pixel i, j took in the last render.
+        return pixels[size_t(j) * imageWidth + i].count;
     }
 
 private:
-    int imageHeight;          // Rendered image height
-    double pixelSamplesScale; // Color scale factor for a sum of pixel samples
-    Point center;             // Camera center
-    Point pixeZeroLoc;        // Location of pixel 0, 0
-    glm::dvec3 pixelDeltaU;   // Offset to pixel to the right
-    glm::dvec3 pixelDeltaV;   // Offset to pixel below
-    glm::dvec3 u, v, w;       // Camera frame basis vectors
-    glm::dvec3 defocusDiskU;  // Defocus disk horizontal radius
-    glm::dvec3 defocusDiskV;  // Defocus disk vertical radius
+    int imageHeight;                // Rendered image height
+    std::vector<PixelStats> pixels; // Accumulated samples of every pixel, row by row
+    std::vector<AovStats> aovs;     // Accumulated first hits of every pixel, empty without aovPath
+    Framebuffer image;              // Linear radiance of the last rendered frame
+    Point center;                   // Camera center
+    Point pixeZeroLoc;              // Location of pixel 0, 0
+    glm::dvec3 pixelDeltaU;         // Offset to pixel to the right
+    glm::dvec3 pixelDeltaV;         // Offset to pixel below
+    double pixelSpread;             // Angle between the rays of neighbouring pixels
+    glm::dvec3 u, v, w;             // Camera frame basis vectors
+    glm::dvec3 defocusDiskU;        // Defocus disk horizontal radius
+    glm::dvec3 defocusDiskV;        // Defocus disk vertical radius
+
+    std::chrono::steady_clock::time_point lastCheckpoint; // Time the last checkpoint was taken
+    std::atomic<long long> pathCount{0};                  // Paths traced in this render
+    std::atomic<long long> pathSegments{0};               // Ray segments traced along those paths
 
     void initialize()
     {
+        // A pixel's noise is estimated from the spread of its samples, which takes two of them.
+        if (adaptiveSampling && adaptiveMinSamples < 2)
+        {
+            std::cerr << "WARNING: Raising adaptiveMinSamples from " << adaptiveMinSamples << " to 2, the fewest a noise estimate needs.\n";
+            adaptiveMinSamples = 2;
+        }
+
         imageHeight = int(imageWidth / aspectRatio);
         imageHeight = (imageHeight < 1) ? 1 : imageHeight;
 
-        pixelSamplesScale = 1.0 / samplesPerPixel;
-
         center = lookFrom;
 
         // Determine viewport dimensions.
@@ -84,6 +191,7 @@ private:
         // Calculate the horizontal and vertical delta vectors from pixel to pixel.
         pixelDeltaU = viewportU / static_cast<double>(imageWidth);
         pixelDeltaV = viewportV / static_cast<double>(imageHeight);
+        pixelSpread = glm::length(pixelDeltaU) / focusDist;
 
         // Calculate the location of the upper left pixel.
         auto viewportUpperLeft = center - (focusDist * w) - viewportU / 2.0 - viewportV / 2.0;
@@ -95,6 +203,269 @@ private:
         defocusDiskV = v * defocusRadius;
     }
 
+    void renderPass(const Hittable& world, const HittableList& lights, ThreadPool& pool, const std::vector<int>& targets)
+    {
+        // Samples every pixel up to its entry in targets. Tiles are rendered in parallel; every
+        // pixel belongs to exactly one tile, so the threads never write to the same element.
+
+        int tilesX = (imageWidth + tileSize - 1) / tileSize;
+        int tilesY = (imageHeight + tileSize - 1) / tileSize;
+        std::atomic<int> tilesRemaining(tilesX * tilesY);
+        std::mutex progressLock;
+
+        pool.parallelFor(tilesX * tilesY, [&](size_t tile, int) {
+            int x0 = int(tile % tilesX) * tileSize;
+            int y0 = int(tile / tilesX) * tileSize;
+            renderTile(world, lights, x0, y0, std::min(x0 + tileSize, imageWidth), std::min(y0 + tileSize, imageHeight), targets);
+
+            int remaining = --tilesRemaining;
+            std::lock_guard<std::mutex> guard(progressLock);
+            std::clog << "\rTiles remaining: " << remaining << ' ' << std::flush;
+        });
+    }
+
+    void renderTile(const Hittable& world, const HittableList& lights, int x0, int y0, int x1, int y1, const std::vector<int>& targets)
+    {
+        // Samples the pixels [x0,x1) x [y0,y1) up to their target counts.
+
+        long long paths = 0;
+        long long segments = 0;
+
+        for (int j = y0; j < y1; j++)
+        {
+            for (int i = x0; i < x1; i++)
+            {
+                auto pixelIndex = size_t(j) * imageWidth + i;
+                auto& pixel = pixels[pixelIndex];
+                for (int sample = pixel.count; sample < targets[pixelIndex]; sample++)
+                {
+                    seedPixelSample(seed, pixelIndex, sample);
+                    Ray r = getRay(i, j);
+
+                    int pathLength;
+                    if (aovs.empty())
+                    {
+                        pixel.add(rayColor(r, world, lights, pathLength));
+                    }
+                    else
+                    {
+                        AovSample aov;
+                        pixel.add(rayColor(r, world, lights, pathLength, &aov));
+                        aovs[pixelIndex].add(aov);
+                    }
+                    paths++;
+                    segments += pathLength;
+                }
+            }
+        }
+
+        pathCount += paths;
+        pathSegments += segments;
+    }
+
+    FeatureBuffers renderFeatures(const Hittable& world, ThreadPool& pool) const
+    {
+        // Traces featureSamples camera rays per pixel to the first surface that is not a mirror
+        // or glass, and averages what they find there. The rays use their own random sequences,
+        // so the rendered samples stay the same with or without the denoiser.
+
+        FeatureBuffers features;
+        features.resize(imageWidth, imageHeight);
+        int tilesX = (imageWidth + tileSize - 1) / tileSize;
+        int tilesY = (imageHeight + tileSize - 1) / tileSize;
+        auto featureSeed = mixBits(seed ^ 0x6665617475726573ULL); // "features"
+
+        pool.parallelFor(size_t(tilesX) * tilesY, [&](size_t tile, int) {
+            int x0 = int(tile % tilesX) * tileSize;
+            int y0 = int(tile / tilesX) * tileSize;
+            for (int j = y0; j < std::min(y0 + tileSize, imageHeight); j++)
+            {
+                for (int i = x0; i < std::min(x0 + tileSize, imageWidth); i++)
+                {
+                    auto pixelIndex = size_t(j) * imageWidth + i;
+                    Color albedoSum(0, 0, 0);
+                    glm::dvec3 normalSum(0, 0, 0);
+                    double depthSum = 0;
+                    int hits = 0;
+
+                    for (int sample = 0; sample < featureSamples; sample++)
+                    {
+                        seedPixelSample(featureSeed, pixelIndex, sample);
+                        Color albedo;
+                        glm::dvec3 normal;
+                        double depth;
+                        firstSurface(getRay(i, j), world, albedo, normal, depth);
+
+                        albedoSum += albedo;
+                        if (depth > 0)
+                        {
+                            normalSum += normal;
+                            depthSum += depth;
+                            hits++;
+                        }
+                    }
+
+                    auto samples = std::max(1, featureSamples);
+                    features.albedo[pixelIndex] = albedoSum / double(samples);
+                    features.normal[pixelIndex] = normalSum / double(samples);
+                    features.depth[pixelIndex] = hits > 0 ? depthSum / hits : 0;
+                }
+            }
+        });
+
+        return features;
+    }
+
+    void firstSurface(const Ray& r, const Hittable& world, Color& albedo, glm::dvec3& normal, double& depth) const
+    {
+        // Follows the ray through up to four specular bounces. The albedo is the weight of the
+        // surface it stops at (the emitted color, up to 1, for lights) times the tints of the
+        // mirrors and glass on the way; depth is the distance along the path, 0 for an escaped ray.
+
+        const auto& materials = materialTable();
+        Color throughput(1, 1, 1);
+        Ray ray = r;
+        double distance = 0;
+        double coneWidth = 0;
+
+        for (int bounce = 0;; bounce++)
+        {
+            HitRecord rec;
+            if (!world.hit(ray, Interval(0.001, INF), rec))
+            {
+                albedo = throughput;
+                normal = glm::dvec3(0, 0, 0);
+                depth = 0;
+                return;
+            }
+            rec.finalize(ray);
+            distance += rec.t * glm::length(ray.direction());
+            coneWidth = setFootprint(ray, coneWidth, rec);
+
+            const Material& material = materials[rec.mat];
+            ScatterSample scatter;
+            bool scattered = material.sample(ray, rec, scatter);
+            if (!scattered || scatter.pdf > 0 || bounce == 4)
+            {
+                auto emitted = glm::min(material.emitted(rec.u, rec.v, rec.p), Color(1, 1, 1));
+                albedo = throughput * (scattered ? scatter.weight : emitted);
+                normal = rec.normal;
+                depth = distance;
+                return;
+            }
+
+            throughput *= scatter.weight;
+            ray = scatter.scattered;
+        }
+    }
+
+    void refineNoisyPixels(const Hittable& world, const HittableList& lights, ThreadPool& pool, std::vector<int>& targets)
+    {
+        // Keeps adding samples to the pixels that have not converged yet, paid for by the samples
+        // the converged pixels left unused, until every pixel converges, hits its cap, or the
+        // budget of samplesPerPixel per pixel is spent. The decisions are made between passes
+        // from the accumulated samples only, so the result does not depend on thread timing.
+
+        auto maxSamples = adaptiveMaxSamples > 0 ? adaptiveMaxSamples : 4 * samplesPerPixel;
+        auto budget = (long long)samplesPerPixel * (long long)pixels.size();
+
+        for (int round = 1;; round++)
+        {
+            long long taken = 0;
+            for (const auto& pixel : pixels)
+                taken += pixel.count;
+
+            // Noisy pixels ask for half again as many samples as they have, at least the minimum.
+            std::vector<size_t> noisy;
+            long long wanted = 0;
+            for (size_t index = 0; index < pixels.size(); index++)
+            {
+                const auto& pixel = pixels[index];
+                if (pixel.count >= maxSamples || pixel.converged(adaptiveThreshold))
+                    continue;
+
+                noisy.push_back(index);
+                wanted += std::min(maxSamples - pixel.count, std::max(adaptiveMinSamples, pixel.count / 2));
+            }
+
+            auto remaining = budget - taken;
+            if (noisy.empty() || remaining <= 0 || wanted <= 0)
+                break;
+
+            // Scale the requests down evenly when they exceed the remaining budget.
+            auto scale = std::fmin(1.0, double(remaining) / double(wanted));
+            bool anySamples = false;
+            for (auto index : noisy)
+            {
+                const auto& pixel = pixels[index];
+                auto extra = int(scale * std::min(maxSamples - pixel.count, std::max(adaptiveMinSamples, pixel.count / 2)));
+                targets[index] = pixel.count + extra;
+                anySamples = anySamples || extra > 0;
+            }
+
+            if (!anySamples)
+                break;
+
+            std::clog << "\rAdaptive pass " << round << ": " << noisy.size() << " noisy pixels         \n";
+            renderPass(world, lights, pool, targets);
+            checkpointIfDue();
+        }
+    }
+
+    CheckpointHeader checkpointHeader() const
+    {
+        // A checkpoint only resumes a render of the same scene and image with the same sampling
+        // settings; anything that changes the estimate of a pixel is part of the header.
+        CheckpointHeader header;
+        header.width = imageWidth;
+        header.height = imageHeight;
+        header.samplesPerPixel = samplesPerPixel;
+        header.adaptive = adaptiveSampling ? 1 : 0;
+        header.seed = seed;
+        header.sceneHash = sceneHash;
+        header.maxDepth = maxDepth;
+        header.rouletteDepth = rouletteDepth;
+        header.sampleLights = sampleLights ? 1 : 0;
+        header.adaptiveMinSamples = adaptiveMinSamples;
+        header.adaptiveMaxSamples = adaptiveMaxSamples;
+        header.adaptiveThreshold = adaptiveThreshold;
+        header.aovs = aovs.empty() ? 0 : 1;
+        return header;
+    }
+
+    void checkpointIfDue()
+    {
+        // Called between passes, when no thread is writing to the pixels.
+        if (checkpointPath.empty())
+            return;
+
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - lastCheckpoint).count() < checkpointInterval)
+            return;
+
+        if (saveCheckpoint(checkpointPath, checkpointHeader(), pixels, aovs))
+            std::clog << "\rCheckpoint saved to '" << checkpointPath << "'     \n";
+        lastCheckpoint = now;
+    }
+
+    void reportSampleCounts() const
+    {
+        int minCount = std::numeric_limits<int>::max();
+        int maxCount = 0;
+        double total = 0;
+        for (const auto& pixel : pixels)
+        {
+            minCount = std::min(minCount, pixel.count);
+            maxCount = std::max(maxCount, pixel.count);
+            total += pixel.count;
+        }
+
+        std::clog << "Samples per pixel: min " << minCount << ", mean " << total / pixels.size() << ", max " << maxCount << '\n';
+
+        if (pathCount > 0)
+            std::clog << "Average path length: " << double(pathSegments) / double(pathCount) << " segments\n";
+    }
+
     Ray getRay(int i, int j) const
     {
         // Construct a camera ray originating from the defocus disk and directed at a randomly
@@ -129,47 +500,140 @@ private:
         return center + (p[0] * defocusDiskU) + (p[1] * defocusDiskV);
     }
 
-    Color rayColor(const Ray& r, int depth, const Hittable& world) const
+    Color rayColor(const Ray& r, const Hittable& world, const HittableList& lights, int& pathLength, AovSample* aov = nullptr) const
     {
-        // If we've exceeded the ray bounce limit, no more light is gathered.
-        if (depth <= 0)
-            return Color(0, 0, 0);
-
-        HitRecord rec;
-
-        if (useBackground)
+        // Follows one light path from the camera, bounce by bounce. The throughput is the product
+        // of the attenuations along the path so far, the weight of anything found further on.
+        // pathLength returns the number of segments traced, and aov, if given, the first hit.
+        //
+        // With sampleLights, every diffuse hit also sends a shadow ray toward a point sampled on
+        // the lights. Light then arrives by two strategies, the light sample and the scattered
+        // ray happening to hit an emitter; multiple importance sampling weights each by how well
+        // it samples that direction (power heuristic), so neither is counted twice. Hits on
+        // emitters after a specular bounce, or before any bounce, keep their full weight.
+
+        const auto& materials = materialTable();
+        bool lightSampling = sampleLights && useBackground && !lights.objects.empty();
+        Color radiance(0, 0, 0);
+        Color throughput(1, 1, 1);
+        Ray ray = r;
+        double scatterPdf = 0; // Density of the last scattered direction, 0 if specular or none
+        double coneWidth = 0;  // Width of the ray's footprint at its origin
+
+        // Stop gathering light once the ray bounce limit is reached.
+        for (pathLength = 1; pathLength <= maxDepth; pathLength++)
         {
-            // If the ray hits nothing, return the background color.
-            if (!world.hit(r, Interval(0.001, INF), rec))
-                return background;
+            HitRecord rec;
 
-            Ray scattered;
-            Color attenuation;
-            Color colorFromEmission = rec.mat->emitted(rec.u, rec.v, rec.p);
+            if (!world.hit(ray, Interval(0.001, INF), rec))
+            {
+                // The ray escapes with the background color, or the sky gradient without one.
+                if (useBackground)
+                    return radiance + throughput * background;
 
-            if (!rec.mat->scatter(r, rec, attenuation, scattered))
-                return colorFromEmission;
+                glm::dvec3 unitDirection = glm::normalize(ray.direction());
+                auto a = 0.5 * (unitDirection.y + 1.0);
+                return radiance + throughput * lerp(Color(1.0, 1.0, 1.0), Color(0.5, 0.7, 1.0), a);
+            }
+            rec.finalize(ray);
+            coneWidth = setFootprint(ray, coneWidth, rec);
+            const Material& material = materials[rec.mat];
 
-            Color colorFromScatter = attenuation * rayColor(scattered, depth - 1, world);
+            if (aov && pathLength == 1)
+            {
+                aov->hit = true;
+                aov->depth = rec.t * glm::length(ray.direction());
+                aov->normal = rec.normal;
+                aov->albedo = material.baseColor(rec);
+                aov->material = rec.mat;
+                aov->primitive = rec.primitive;
+            }
 
-            return colorFromEmission + colorFromScatter;
-        }
-        else
-        {
-            if (world.hit(r, Interval(0.001, INF), rec))
+            // Emission only counts in scenes lit by a background color.
+            if (useBackground)
             {
-                Ray scattered;
-                Color attenuation;
-                if (rec.mat->scatter(r, rec, attenuation, scattered))
-                    return attenuation * rayColor(scattered, depth - 1, world);
-                return Color(0, 0, 0);
+                auto emitted = material.emitted(rec.u, rec.v, rec.p);
+                if (lightSampling && scatterPdf > 0 && emitted != Color(0, 0, 0))
+                    emitted *= powerHeuristic(scatterPdf, lights.pdfValue(ray.origin(), ray.direction()));
+                radiance += throughput * emitted;
             }
 
-            glm::dvec3 unitDirection = glm::normalize(r.direction());
-            auto a = 0.5 * (unitDirection.y + 1.0);
+            ScatterSample scatter;
+            if (!material.sample(ray, rec, scatter))
+                return radiance;
 
-            return lerp(Color(1.0, 1.0, 1.0), Color(0.5, 0.7, 1.0), a);
+            // Light sampling stops one bounce early, where the scattered ray could not find the
+            // light anymore, so both strategies cover the same path lengths.
+            scatterPdf = lightSampling && pathLength < maxDepth ? scatter.pdf : 0;
+            if (scatterPdf > 0)
+                radiance += throughput * sampleLight(ray, rec, material, world, lights);
+
+            throughput *= scatter.weight;
+            ray = scatter.scattered;
+
+            // Russian roulette: past rouletteDepth, a path survives with a probability equal to its
+            // largest throughput component, and survivors are weighted up by its inverse. That
+            // keeps the estimate unbiased while dark paths mostly stop early.
+            if (rouletteDepth >= 0 && pathLength >= rouletteDepth)
+            {
+                auto survival = std::fmin(1.0, std::fmax(throughput.x, std::fmax(throughput.y, throughput.z)));
+                if (randomDoubleGen() >= survival)
+                    return radiance;
+                throughput /= survival;
+            }
         }
+
+        pathLength = maxDepth;
+        return radiance;
+    }
+
+    double setFootprint(const Ray& ray, double coneWidth, HitRecord& rec) const
+    {
+        // Ray differentials in their isotropic ray cone form. A camera ray stands for the cone
+        // between it and the rays of the neighbouring pixels, which starts with width 0 and
+        // widens by pixelSpread per unit of distance. Scattered rays carry on from the width at
+        // their hit with the same spread; surface curvature and roughness are not taken into
+        // account. The cone's cross-section is stretched over the surface by the angle of
+        // incidence (as a circle of the same area as the ellipse) and measured in texture
+        // units through dp/du and dp/dv. Returns the cone width at the hit.
+        auto length = glm::length(ray.direction());
+        auto width = coneWidth + pixelSpread * rec.t * length;
+        auto cosine = std::fabs(glm::dot(rec.normal, ray.direction())) / length;
+        auto surfaceWidth = width / std::sqrt(std::fmax(cosine, 1e-3));
+
+        auto uLength = glm::length(rec.dpdu);
+        auto vLength = glm::length(rec.dpdv);
+        rec.footprint = glm::dvec2(uLength > 0 ? surfaceWidth / uLength : 0, vLength > 0 ? surfaceWidth / vLength : 0);
+        return width;
+    }
+
+    Color sampleLight(const Ray& rayIn, const HitRecord& rec, const Material& material, const Hittable& world, const HittableList& lights) const
+    {
+        // Returns the light scattered at rec from a point sampled on the lights, with the MIS
+        // weight of the light sample.
+
+        Ray toLight(rec.p, glm::normalize(lights.random(rec.p)), rayIn.time());
+        auto lightPdf = lights.pdfValue(toLight.origin(), toLight.direction());
+        auto scatterPdf = material.pdf(rayIn, rec, toLight.direction());
+        if (lightPdf <= 0 || scatterPdf <= 0)
+            return Color(0, 0, 0);
+
+        // Find the point on the lights the direction leads to, then whether anything is in between.
+        HitRecord lightRec;
+        if (!lights.hit(toLight, Interval(0.001, INF), lightRec))
+            return Color(0, 0, 0);
+        lightRec.finalize(toLight);
+        if (world.occluded(toLight, Interval(0.001, lightRec.t - 0.001)))
+            return Color(0, 0, 0);
+
+        auto emitted = materialTable()[lightRec.mat].emitted(lightRec.u, lightRec.v, lightRec.p);
+        return material.eval(rayIn, rec, toLight.direction()) * emitted * (powerHeuristic(lightPdf, scatterPdf) / lightPdf);
+    }
+
+    static double powerHeuristic(double pdf, double otherPdf)
+    {
+        // MIS weight of a sample drawn with density pdf, against a second strategy with otherPdf.
+        return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
     }
 };
 
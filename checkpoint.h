@@ -0,0 +1,195 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include "aov.h"
+#include "framebuffer.h"
+
+#include <cstdint>
+#include <cstdio> // std::fopen(), std::rename(), std::remove()
+#include <cstring> // std::memcpy()
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h> // fsync()
+#endif
+
+// A checkpoint holds the running sums and sample counts of every pixel, and of a render with AOVs
+// also the first hit sums of every pixel. The random sequence of a sample is derived from (seed,
+// pixel, sample index) alone, so the seed stored in the header together with the counts is the
+// complete sampler state: a resumed render draws exactly the samples the interrupted one would
+// have drawn, and accumulates them in the same order.
+
+struct CheckpointHeader
+{
+    uint32_t magic = 0x4b435452; // "RTCK"
+    uint32_t version = 3;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t samplesPerPixel = 0;
+    int32_t adaptive = 0;
+    uint64_t seed = 0;
+    uint64_t sceneHash = 0; // Camera::sceneHash, of the scene file path and text
+    int32_t maxDepth = 0;
+    int32_t rouletteDepth = 0;
+    int32_t sampleLights = 0;
+    int32_t adaptiveMinSamples = 0;
+    int32_t adaptiveMaxSamples = 0;
+    int32_t aovs = 0; // Whether AovStats follow the pixels
+    double adaptiveThreshold = 0;
+
+    bool matches(const CheckpointHeader& other) const
+    {
+        return magic == other.magic && version == other.version && width == other.width && height == other.height &&
+               samplesPerPixel == other.samplesPerPixel && adaptive == other.adaptive && seed == other.seed &&
+               sceneHash == other.sceneHash && maxDepth == other.maxDepth && rouletteDepth == other.rouletteDepth &&
+               sampleLights == other.sampleLights && adaptiveMinSamples == other.adaptiveMinSamples &&
+               adaptiveMaxSamples == other.adaptiveMaxSamples && adaptiveThreshold == other.adaptiveThreshold && aovs == other.aovs;
+    }
+};
+
+namespace checkpoint_detail
+{
+// Every pixel is stored as five doubles (sum.x, sum.y, sum.z, lumSum, lumSqSum) and an int32
+// count, in the byte order of the machine that wrote it.
+const size_t pixelBytes = 5 * sizeof(double) + sizeof(int32_t);
+
+// The AOVs of a pixel follow as seven doubles (albedoSum.xyz, normalSum.xyz, depthSum) and four
+// 32-bit integers (hits, count, material, primitive).
+const size_t aovBytes = 7 * sizeof(double) + 4 * sizeof(int32_t);
+
+template <typename T>
+void put(char*& out, T value)
+{
+    std::memcpy(out, &value, sizeof(T));
+    out += sizeof(T);
+}
+
+template <typename T>
+T take(const char*& in)
+{
+    T value;
+    std::memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+}
+} // namespace checkpoint_detail
+
+inline bool saveCheckpoint(const std::string& path, const CheckpointHeader& header, const std::vector<PixelStats>& pixels,
+                           const std::vector<AovStats>& aovs)
+{
+    // Writes the checkpoint to a temporary file next to path and renames it over path once it is
+    // complete and flushed to disk, so neither a crash mid-write nor a power loss right after
+    // the rename leaves a truncated checkpoint behind. aovs is empty, or has an entry per pixel
+    // if header.aovs is set.
+    using namespace checkpoint_detail;
+
+    std::vector<char> buffer(sizeof(CheckpointHeader) + pixels.size() * pixelBytes + aovs.size() * aovBytes);
+    std::memcpy(buffer.data(), &header, sizeof(CheckpointHeader));
+
+    char* out = buffer.data() + sizeof(CheckpointHeader);
+    for (const auto& pixel : pixels)
+    {
+        put(out, pixel.sum.x);
+        put(out, pixel.sum.y);
+        put(out, pixel.sum.z);
+        put(out, pixel.lumSum);
+        put(out, pixel.lumSqSum);
+        put(out, int32_t(pixel.count));
+    }
+    for (const auto& aov : aovs)
+    {
+        put(out, aov.albedoSum.x);
+        put(out, aov.albedoSum.y);
+        put(out, aov.albedoSum.z);
+        put(out, aov.normalSum.x);
+        put(out, aov.normalSum.y);
+        put(out, aov.normalSum.z);
+        put(out, aov.depthSum);
+        put(out, int32_t(aov.hits));
+        put(out, int32_t(aov.count));
+        put(out, uint32_t(aov.material));
+        put(out, uint32_t(aov.primitive));
+    }
+
+    auto tempPath = path + ".tmp";
+    std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+    bool written = file != nullptr && std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size() && std::fflush(file) == 0;
+#if defined(__unix__) || defined(__APPLE__)
+    written = written && fsync(fileno(file)) == 0;
+#endif
+    if (file != nullptr)
+        written = std::fclose(file) == 0 && written;
+    if (!written)
+    {
+        std::cerr << "ERROR: Could not write checkpoint file '" << tempPath << "'.\n";
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "ERROR: Could not replace checkpoint file '" << path << "'.\n";
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+inline bool loadCheckpoint(const std::string& path, const CheckpointHeader& expected, std::vector<PixelStats>& pixels, std::vector<AovStats>& aovs)
+{
+    // Restores the pixels, and the AOVs if expected.aovs is set, from the checkpoint at path.
+    // Returns false, leaving both alone, if there is no checkpoint or it belongs to a different
+    // render.
+    using namespace checkpoint_detail;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    CheckpointHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(CheckpointHeader)) || !header.matches(expected))
+    {
+        std::cerr << "WARNING: Ignoring checkpoint '" << path << "', it does not match this render.\n";
+        return false;
+    }
+
+    std::vector<char> buffer(pixels.size() * pixelBytes + (header.aovs ? aovs.size() * aovBytes : 0));
+    if (!file.read(buffer.data(), buffer.size()))
+    {
+        std::cerr << "WARNING: Ignoring truncated checkpoint '" << path << "'.\n";
+        return false;
+    }
+
+    const char* in = buffer.data();
+    for (auto& pixel : pixels)
+    {
+        pixel.sum.x = take<double>(in);
+        pixel.sum.y = take<double>(in);
+        pixel.sum.z = take<double>(in);
+        pixel.lumSum = take<double>(in);
+        pixel.lumSqSum = take<double>(in);
+        pixel.count = take<int32_t>(in);
+    }
+    if (header.aovs)
+    {
+        for (auto& aov : aovs)
+        {
+            aov.albedoSum.x = take<double>(in);
+            aov.albedoSum.y = take<double>(in);
+            aov.albedoSum.z = take<double>(in);
+            aov.normalSum.x = take<double>(in);
+            aov.normalSum.y = take<double>(in);
+            aov.normalSum.z = take<double>(in);
+            aov.depthSum = take<double>(in);
+            aov.hits = take<int32_t>(in);
+            aov.count = take<int32_t>(in);
+            aov.material = take<uint32_t>(in);
+            aov.primitive = take<uint32_t>(in);
+        }
+    }
+    return true;
+}
+
+#endif//_CHECKPOINT_H_
@@ -5,6 +5,12 @@
 
 using Color = glm::dvec3;
 
+inline double luminance(const Color& c)
+{
+    // Relative luminance of a linear sRGB color (Rec. 709 primaries).
+    return 0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z;
+}
+
 inline double linearToGamma(double linearComponent)
 {
     if (linearComponent > 0)
@@ -13,25 +19,18 @@ inline double linearToGamma(double linearComponent)
     return 0;
 }
 
-void writeColor(std::ostream& out, const Color& pixelColor)
+inline unsigned char linearToByte(double linearComponent)
 {
-    auto r = pixelColor.x;
-    auto g = pixelColor.y;
-    auto b = pixelColor.z;
-
-    // Apply a linear to gamma transform for gamma 2
-    r = linearToGamma(r);
-    g = linearToGamma(g);
-    b = linearToGamma(b);
-
-    // Translate the [0,1] component values to the byte range [0,255].
+    // Apply a linear to gamma transform for gamma 2, then translate the [0,1] component value
+    // to the byte range [0,255].
     static const Interval intensity(0.000, 0.999);
-    int rbyte = int(256 * intensity.clamp(r));
-    int gbyte = int(256 * intensity.clamp(g));
-    int bbyte = int(256 * intensity.clamp(b));
+    return static_cast<unsigned char>(256 * intensity.clamp(linearToGamma(linearComponent)));
+}
 
-    // Write out the pixel Color components.
-    out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
+void writeColor(std::ostream& out, const Color& pixelColor)
+{
+    // Write out the pixel Color components as plain text.
+    out << int(linearToByte(pixelColor.x)) << ' ' << int(linearToByte(pixelColor.y)) << ' ' << int(linearToByte(pixelColor.z)) << '\n';
 }
 
 #endif//_COLOR_H_
\ No newline at end of file
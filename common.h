@@ -14,6 +14,9 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/constants.hpp>
 
+/* Random Numbers */
+#include "sampler.h"
+
 /* C++ Std Usings */
 using std::make_shared;
 using std::shared_ptr;
@@ -32,6 +35,12 @@ class Timer
     std::chrono::time_point<clock_t> start_time = clock_t::now();
 
 public:
+    double seconds() const
+    {
+        // Returns the seconds passed since the timer was created.
+        return std::chrono::duration_cast<secont_t>(clock_t::now() - start_time).count();
+    }
+
     void elapsed()
     {
         std::chrono::time_point<clock_t> end_time = clock_t::now();
@@ -49,8 +58,8 @@ using Point = glm::dvec3;
 
 inline double randomDoubleGen()
 {
-    // Returns a random real in [0,1).
-    return std::rand() / (RAND_MAX + 1.0);
+    // Returns a random real in [0,1) from the calling thread's sampler.
+    return threadSampler().nextDouble();
 }
 
 inline double randomDoubleGen(double min, double max)
@@ -113,6 +122,30 @@ inline glm::dvec3 randomOnHemisphere(const glm::dvec3& normal)
         return -onUnitSphere;
 }
 
+inline glm::dvec3 randomCosineDirection()
+{
+    // Returns a unit vector around +z with density cos(theta) / pi, in closed form: a uniform
+    // point on the unit disk lifted onto the hemisphere.
+    auto r1 = randomDoubleGen();
+    auto r2 = randomDoubleGen();
+
+    auto phi = 2 * PI * r1;
+    auto x = std::cos(phi) * std::sqrt(r2);
+    auto y = std::sin(phi) * std::sqrt(r2);
+    auto z = std::sqrt(1 - r2);
+
+    return glm::dvec3(x, y, z);
+}
+
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+    // 64-bit FNV-1a; pass the result back in as hash to continue over further bytes.
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
 inline glm::dvec3 reflect(const glm::dvec3& v, const glm::dvec3& n) { return v - 2 * glm::dot(v, n) * n; }
 
 inline glm::dvec3 refract(const glm::dvec3& uv, const glm::dvec3& n, double etaiOverEtat)
@@ -129,6 +162,7 @@ inline double degreesToRadians(double degrees) { return degrees * PI / 180.0; }
 /* Common Headers */
 #include "color.h"
 #include "interval.h"
+#include "onb.h"
 #include "ray.h"
 
 #endif//_COMMON_H_
\ No newline at end of file
@@ -9,15 +9,16 @@ class ConstantMedium : public Hittable
 {
 public:
     ConstantMedium(shared_ptr<Hittable> boundary, double density, shared_ptr<Texture> tex)
-        : boundary(boundary), negInvDensity(-1 / density), phaseFunction(make_shared<Isotropic>(tex))
+        : boundary(boundary), negInvDensity(-1 / density), phaseFunction(materialTable().add(make_shared<Isotropic>(tex)))
     {}
 
     ConstantMedium(shared_ptr<Hittable> boundary, double density, const Color& albedo)
-        : boundary(boundary), negInvDensity(-1 / density), phaseFunction(make_shared<Isotropic>(albedo))
+        : boundary(boundary), negInvDensity(-1 / density), phaseFunction(materialTable().add(make_shared<Isotropic>(albedo)))
     {}
 
     bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
     {
+        // Only the distances of the boundary hits matter, so they are never finalized.
         HitRecord rec1, rec2;
 
         if (!boundary->hit(r, Interval::universe, rec1))
@@ -50,16 +51,27 @@ public:
         rec.normal = glm::dvec3(1, 0, 0); // arbitrary
         rec.frontFace = true;             // also arbitrary
         rec.mat = phaseFunction;
+        rec.object = nullptr;
+        rec.dpdu = glm::dvec3(0, 0, 0);
+        rec.dpdv = glm::dvec3(0, 0, 0);
 
         return true;
     }
 
+    bool occluded(const Ray& r, Interval rayT) const override
+    {
+        // The medium blocks the ray where it would scatter it, so this samples a distance just
+        // like hit().
+        HitRecord rec;
+        return hit(r, rayT, rec);
+    }
+
     Aabb boundingBox() const override { return boundary->boundingBox(); }
 
 private:
     shared_ptr<Hittable> boundary;
     double negInvDensity;
-    shared_ptr<Material> phaseFunction;
+    MaterialId phaseFunction;
 };
 
 #endif//_CONSTANT_MEDIUM_H_
\ No newline at end of file
@@ -0,0 +1,214 @@
+#ifndef _DENOISER_H_
+#define _DENOISER_H_
+
+#include "framebuffer.h"
+#include "thread_pool.h"
+
+#include <algorithm> // std::min(), std::max()
+#include <cmath>
+#include <vector>
+
+struct FeatureBuffers
+{
+    // What the camera rays of every pixel see first, averaged over a few rays per pixel: the
+    // albedo, normal and distance of the first non-specular surface (found through mirrors and
+    // glass), row by row. Pixels whose rays escape have a zero normal and depth.
+
+    int width = 0;
+    int height = 0;
+    std::vector<Color> albedo;
+    std::vector<glm::dvec3> normal;
+    std::vector<double> depth;
+
+    void resize(int w, int h)
+    {
+        width = w;
+        height = h;
+        albedo.assign(size_t(w) * h, Color(0, 0, 0));
+        normal.assign(size_t(w) * h, glm::dvec3(0, 0, 0));
+        depth.assign(size_t(w) * h, 0.0);
+    }
+};
+
+class Denoiser
+{
+    // Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with the variance-guided
+    // luminance weight of SVGF (Schied et al. 2017). Every pass blurs with a 5x5 B3 spline kernel
+    // whose taps are 2^pass pixels apart, so five passes cover a 125 pixel wide footprint at 25
+    // taps per pixel and pass. Each tap is weighted down by how much its normal, depth and noisy
+    // luminance differ from the center pixel's, which keeps geometric and lighting edges sharp.
+    //
+    // The filter works on illumination, the color divided by the first-hit albedo; the albedo is
+    // multiplied back in at the end, so texture detail is never blurred.
+
+public:
+    static constexpr int maxIterations = 10; // Pass n steps 2^n pixels; later passes skip past most images
+
+    int iterations = 5;         // Filter passes, at most maxIterations
+    double sigmaLuminance = 4;  // Luminance edge stopping, in standard deviations of the pixel noise
+    double sigmaNormal = 128;   // Exponent of the normal similarity (higher keeps creases sharper)
+    double sigmaDepth = 1;      // Depth edge stopping, relative to the local depth gradient
+    int tileSize = 32;          // Edge length in pixels of the tiles handed out to the threads
+
+    Framebuffer apply(const Framebuffer& image, const std::vector<double>& variance, const FeatureBuffers& features, ThreadPool& pool) const
+    {
+        // Returns the filtered image. variance holds the variance of the mean luminance of every
+        // pixel, the noise the luminance weight is measured against.
+
+        int width = image.width();
+        int height = image.height();
+        size_t count = size_t(width) * height;
+
+        // Demodulate, and scale the variance by the same factor.
+        std::vector<Color> illumination(count);
+        std::vector<double> illuminationVariance(count);
+        std::vector<Color> albedo(count);
+        for (size_t index = 0; index < count; index++)
+        {
+            albedo[index] = features.albedo[index];
+            auto factor = Color(1, 1, 1);
+            for (int c = 0; c < 3; c++)
+            {
+                if (albedo[index][c] < 0.01)
+                    albedo[index][c] = 1;
+                factor[c] = 1 / albedo[index][c];
+            }
+
+            illumination[index] = image.get(int(index % width), int(index / width)) * factor;
+            illuminationVariance[index] = variance[index] * luminance(factor) * luminance(factor);
+        }
+
+        std::vector<glm::dvec3> normals(count);
+        for (size_t index = 0; index < count; index++)
+        {
+            auto n = features.normal[index];
+            auto length = glm::length(n);
+            normals[index] = length > 0 ? n / length : glm::dvec3(0, 0, 0);
+        }
+
+        auto gradients = depthGradients(features);
+
+        std::vector<Color> nextIllumination(count);
+        std::vector<double> nextVariance(count);
+        int tilesX = (width + tileSize - 1) / tileSize;
+        int tilesY = (height + tileSize - 1) / tileSize;
+
+        for (int pass = 0; pass < std::min(iterations, maxIterations); pass++)
+        {
+            int step = 1 << pass;
+            pool.parallelFor(size_t(tilesX) * tilesY, [&](size_t tile, int) {
+                int x0 = int(tile % tilesX) * tileSize;
+                int y0 = int(tile / tilesX) * tileSize;
+                for (int y = y0; y < std::min(y0 + tileSize, height); y++)
+                    for (int x = x0; x < std::min(x0 + tileSize, width); x++)
+                        filterPixel(x, y, step, width, height, illumination, illuminationVariance, normals, features.depth, gradients,
+                                    nextIllumination, nextVariance);
+            });
+            illumination.swap(nextIllumination);
+            illuminationVariance.swap(nextVariance);
+        }
+
+        Framebuffer result(width, height);
+        for (size_t index = 0; index < count; index++)
+            result.set(int(index % width), int(index / width), illumination[index] * albedo[index]);
+        return result;
+    }
+
+private:
+    static std::vector<glm::dvec2> depthGradients(const FeatureBuffers& features)
+    {
+        // Screen space depth change per pixel, the smaller of the one-sided differences so a
+        // silhouette next to the pixel does not count as a slope.
+        int width = features.width;
+        int height = features.height;
+        std::vector<glm::dvec2> gradients(size_t(width) * height, glm::dvec2(0, 0));
+
+        auto depthAt = [&](int x, int y) { return features.depth[size_t(y) * width + x]; };
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                auto z = depthAt(x, y);
+                auto gx = std::min(x > 0 ? std::fabs(z - depthAt(x - 1, y)) : INF, x + 1 < width ? std::fabs(depthAt(x + 1, y) - z) : INF);
+                auto gy = std::min(y > 0 ? std::fabs(z - depthAt(x, y - 1)) : INF, y + 1 < height ? std::fabs(depthAt(x, y + 1) - z) : INF);
+                gradients[size_t(y) * width + x] = glm::dvec2(std::isfinite(gx) ? gx : 0, std::isfinite(gy) ? gy : 0);
+            }
+        }
+        return gradients;
+    }
+
+    void filterPixel(int x, int y, int step, int width, int height, const std::vector<Color>& illumination,
+                     const std::vector<double>& variance, const std::vector<glm::dvec3>& normals, const std::vector<double>& depth,
+                     const std::vector<glm::dvec2>& gradients, std::vector<Color>& out, std::vector<double>& outVariance) const
+    {
+        static const double kernel[3] = {3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0};
+
+        size_t center = size_t(y) * width + x;
+        auto centerLuminance = luminance(illumination[center]);
+        const auto& centerNormal = normals[center];
+        auto centerDepth = depth[center];
+        const auto& gradient = gradients[center];
+        bool centerHit = centerNormal != glm::dvec3(0, 0, 0);
+
+        // The luminance weight measures against a 3x3 blur of the variance, which is itself
+        // noisy at low sample counts.
+        double blurredVariance = 0, blurWeight = 0;
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                int sx = x + dx, sy = y + dy;
+                if (sx < 0 || sx >= width || sy < 0 || sy >= height)
+                    continue;
+                auto weight = (dx == 0 ? 0.5 : 0.25) * (dy == 0 ? 0.5 : 0.25);
+                blurredVariance += weight * variance[size_t(sy) * width + sx];
+                blurWeight += weight;
+            }
+        }
+        auto luminanceScale = sigmaLuminance * std::sqrt(std::fmax(0.0, blurredVariance / blurWeight)) + 1e-10;
+
+        Color sum(0, 0, 0);
+        double weightSum = 0, varianceSum = 0;
+
+        for (int dy = -2; dy <= 2; dy++)
+        {
+            for (int dx = -2; dx <= 2; dx++)
+            {
+                int sx = x + dx * step, sy = y + dy * step;
+                if (sx < 0 || sx >= width || sy < 0 || sy >= height)
+                    continue;
+
+                size_t sample = size_t(sy) * width + sx;
+                auto weight = kernel[std::abs(dx)] * kernel[std::abs(dy)];
+
+                if (sample != center)
+                {
+                    // Escaped rays only mix with each other; surfaces mix with similar surfaces.
+                    const auto& sampleNormal = normals[sample];
+                    bool sampleHit = sampleNormal != glm::dvec3(0, 0, 0);
+                    if (centerHit != sampleHit)
+                        continue;
+
+                    if (centerHit)
+                    {
+                        weight *= std::pow(std::fmax(0.0, glm::dot(centerNormal, sampleNormal)), sigmaNormal);
+                        auto expectedDepthChange = std::fabs(gradient.x * dx * step) + std::fabs(gradient.y * dy * step);
+                        weight *= std::exp(-std::fabs(centerDepth - depth[sample]) / (sigmaDepth * expectedDepthChange + 1e-3 * centerDepth));
+                    }
+
+                    weight *= std::exp(-std::fabs(centerLuminance - luminance(illumination[sample])) / luminanceScale);
+                }
+
+                sum += weight * illumination[sample];
+                varianceSum += weight * weight * variance[sample];
+                weightSum += weight;
+            }
+        }
+
+        // The center tap always contributes, so weightSum > 0.
+        out[center] = sum / weightSum;
+        outVariance[center] = varianceSum / (weightSum * weightSum);
+    }
+};
+
+#endif//_DENOISER_H_
@@ -0,0 +1,84 @@
+#ifndef _FRAMEBUFFER_H_
+#define _FRAMEBUFFER_H_
+
+#include <vector>
+
+struct PixelStats
+{
+    // Running sums of the samples taken by one pixel.
+
+    Color sum = Color(0, 0, 0); // Sum of the sample colors
+    double lumSum = 0;          // Sum of the sample luminances
+    double lumSqSum = 0;        // Sum of the squared sample luminances
+    int count = 0;              // Number of samples taken
+
+    void add(const Color& sample)
+    {
+        auto lum = luminance(sample);
+        sum += sample;
+        lumSum += lum;
+        lumSqSum += lum * lum;
+        count++;
+    }
+
+    Color mean() const { return count > 0 ? sum / double(count) : Color(0, 0, 0); }
+
+    double meanVariance() const
+    {
+        // Estimated variance of the mean luminance, from the spread of the samples.
+        if (count < 2)
+            return 0;
+
+        auto mean = lumSum / count;
+        return std::fmax(0.0, (lumSqSum - lumSum * mean) / (count - 1)) / count;
+    }
+
+    bool converged(double threshold) const
+    {
+        // Compares the 95% confidence interval of the mean luminance against the threshold.
+        // The error is carried through the gamma 2 output transform first, where
+        // d(sqrt(L)) = dL / (2 sqrt(L)), so the threshold reads in display units and dark
+        // pixels are held to the tighter bound the eye expects of them.
+        if (count < 2)
+            return false;
+
+        auto mean = lumSum / count;
+        auto error = 1.96 * std::sqrt(meanVariance());
+        return error <= threshold * 2 * std::sqrt(std::fmax(mean, 1e-4));
+    }
+};
+
+class Framebuffer
+{
+    // Linear float RGB radiance, three floats per pixel, rows from top to bottom.
+
+public:
+    Framebuffer() {}
+    Framebuffer(int width, int height) : imageWidth(width), imageHeight(height), rgb(size_t(width) * height * 3, 0.0f) {}
+
+    int width() const { return imageWidth; }
+    int height() const { return imageHeight; }
+
+    void set(int x, int y, const Color& pixelColor)
+    {
+        float* pixel = &rgb[(size_t(y) * imageWidth + x) * 3];
+        pixel[0] = float(pixelColor.x);
+        pixel[1] = float(pixelColor.y);
+        pixel[2] = float(pixelColor.z);
+    }
+
+    Color get(int x, int y) const
+    {
+        const float* pixel = &rgb[(size_t(y) * imageWidth + x) * 3];
+        return Color(pixel[0], pixel[1], pixel[2]);
+    }
+
+    const float* data() const { return rgb.data(); }
+
+private:
+    int imageWidth = 0;
+    int imageHeight = 0;
+    std::vector<float> rgb;
+};
+
+#endif//_FRAMEBUFFER_H_
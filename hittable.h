@@ -2,19 +2,40 @@
 #define _HITTABLE_H_
 
 #include "aabb.h"
+#include "resource_table.h"
 
-class Material;
+#include <cstdint>
+
+class Hittable;
 
 class HitRecord
 {
+    // Intersection tests only fill in t, object, primitive and the surface parameters u and v;
+    // finalize() computes the rest, once, for the closest hit. Hits that closer ones replace
+    // during traversal never pay for their normals or texture coordinates.
+    //
+    // Transform wrappers defer their part the same way: hitWrapped() keeps the object the
+    // wrapped hittable left in the record on a stack, deferWrapper() puts the wrapper in its
+    // place, and the wrapper's finalizeHit() calls unwrap() and finalizes in object space.
+
 public:
     Point p;
     glm::dvec3 normal;
-    shared_ptr<Material> mat;
+    MaterialId mat;
     double t;
     double u;
     double v;
     bool frontFace;
+    const Hittable* object = nullptr; // Primitive or transform wrapper that still has to fill in the record, or nullptr
+    uint32_t primitive = 0;           // Which part of object was hit, e.g. the triangle of a mesh
+
+    glm::dvec3 dpdu = glm::dvec3(0, 0, 0);  // Change of p per unit of u, and of v; zero where the surface
+    glm::dvec3 dpdv = glm::dvec3(0, 0, 0);  // has no parameterization (media)
+    glm::dvec2 footprint = glm::dvec2(0, 0); // Width in u and v of the area the sample covers, set by the camera
+
+    static constexpr int maxWrapped = 8;
+    const Hittable* wrapped[maxWrapped] = {}; // Objects below the wrappers still to be finalized, innermost first
+    int wrappedCount = 0;
 
     void setFaceNormal(const Ray& r, const glm::dvec3& outwardNormal)
     {
@@ -24,6 +45,23 @@ public:
         frontFace = glm::dot(r.direction(), outwardNormal) < 0;
         normal = frontFace ? outwardNormal : -outwardNormal;
     }
+
+    void finalize(const Ray& r);
+
+    bool hitWrapped(const Hittable& object, const Ray& objectRay, Interval rayT);
+
+    bool deferWrapper(const Hittable* wrapper)
+    {
+        // Returns false, leaving the record alone, when wrappers are nested deeper than the
+        // stack; the caller then finalizes at once.
+        if (wrappedCount == maxWrapped)
+            return false;
+        wrapped[wrappedCount++] = object;
+        object = wrapper;
+        return true;
+    }
+
+    void unwrap() { object = wrapped[--wrappedCount]; }
 };
 
 class Hittable
@@ -32,8 +70,49 @@ public:
     virtual ~Hittable() = default;
     virtual bool hit(const Ray& r, Interval rayT, HitRecord& rec) const = 0;
     virtual Aabb boundingBox() const = 0;
+
+    // Returns whether anything is hit within rayT, e.g. for shadow rays. Stops at the first
+    // hit found, which need not be the closest, and fills in no hit record. The default goes
+    // through hit(); aggregates override it so they can return early.
+    virtual bool occluded(const Ray& r, Interval rayT) const
+    {
+        HitRecord rec;
+        return hit(r, rayT, rec);
+    }
+
+    // Light sampling: random() returns a direction from origin toward a random point of the
+    // object, and pdfValue() the solid angle density with which random() picks direction (0 if
+    // the direction misses the object). Only objects that can be sampled as lights implement them.
+    virtual double pdfValue(const Point& origin, const glm::dvec3& direction) const { return 0.0; }
+    virtual glm::dvec3 random(const Point& origin) const { return glm::dvec3(1, 0, 0); }
+
+    // Fills in the point, normal, material and texture coordinates of a hit found by hit(). r is
+    // the ray passed to hit(). Hittables that fill in the whole record in hit() set rec.object
+    // to nullptr and need not override this.
+    virtual void finalizeHit(const Ray& r, HitRecord& rec) const {}
 };
 
+inline void HitRecord::finalize(const Ray& r)
+{
+    if (object != nullptr)
+    {
+        object->finalizeHit(r, *this);
+        object = nullptr;
+    }
+}
+
+inline bool HitRecord::hitWrapped(const Hittable& wrappedObject, const Ray& objectRay, Interval rayT)
+{
+    // Wrappers inside wrappedObject stack from the bottom, so the stack never grows deeper than
+    // the nesting. A miss leaves the record as it was, stack included.
+    int outerCount = wrappedCount;
+    wrappedCount = 0;
+    if (wrappedObject.hit(objectRay, rayT, *this))
+        return true;
+    wrappedCount = outerCount;
+    return false;
+}
+
 class Translate : public Hittable
 {
 public:
@@ -42,24 +121,43 @@ public:
     bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
     {
         // Move the ray backwards by the offset
-        Ray offsetR(r.origin() - offset, r.direction(), r.time());
+        Ray offsetR(r, r.origin() - offset);
 
         // Determine whether an intersection exists along the offset ray (and if so, where)
-        if (!object->hit(offsetR, rayT, rec))
+        if (!rec.hitWrapped(*object, offsetR, rayT))
             return false;
-
-        // Move the intersection point forwards by the offset
-        rec.p += offset;
+        if (!rec.deferWrapper(this))
+            finalizeWrapped(offsetR, rec);
 
         return true;
     }
 
+    void finalizeHit(const Ray& r, HitRecord& rec) const override
+    {
+        rec.unwrap();
+        finalizeWrapped(Ray(r, r.origin() - offset), rec);
+    }
+
+    bool occluded(const Ray& r, Interval rayT) const override { return object->occluded(Ray(r, r.origin() - offset), rayT); }
+
+    double pdfValue(const Point& origin, const glm::dvec3& direction) const override { return object->pdfValue(origin - offset, direction); }
+
+    glm::dvec3 random(const Point& origin) const override { return object->random(origin - offset); }
+
     Aabb boundingBox() const override { return bbox; }
 
 private:
     shared_ptr<Hittable> object;
     glm::dvec3 offset;
     Aabb bbox;
+
+    void finalizeWrapped(const Ray& offsetR, HitRecord& rec) const
+    {
+        rec.finalize(offsetR);
+
+        // Move the intersection point forwards by the offset
+        rec.p += offset;
+    }
 };
 
 class RotateY : public Hittable
@@ -104,35 +202,36 @@ public:
 
     bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
     {
-
-        // Transform the ray from world space to object space.
-
-        auto origin = Point((cosTheta * r.origin().x) - (sinTheta * r.origin().z)
-                            , r.origin().y
-                            , (sinTheta * r.origin().x) + (cosTheta * r.origin().z));
-
-        auto direction = glm::dvec3((cosTheta * r.direction().x) - (sinTheta * r.direction().z)
-                                    , r.direction().y
-                                    , (sinTheta * r.direction().x) + (cosTheta * r.direction().z));
-
-        Ray rotated_r(origin, direction, r.time());
+        Ray rotated_r = objectRay(r);
 
         // Determine whether an intersection exists in object space (and if so, where).
 
-        if (!object->hit(rotated_r, rayT, rec))
+        if (!rec.hitWrapped(*object, rotated_r, rayT))
             return false;
+        if (!rec.deferWrapper(this))
+            finalizeWrapped(rotated_r, rec);
 
-        // Transform the intersection from object space back to world space.
+        return true;
+    }
+
+    void finalizeHit(const Ray& r, HitRecord& rec) const override
+    {
+        rec.unwrap();
+        finalizeWrapped(objectRay(r), rec);
+    }
 
-        rec.p = Point((cosTheta * rec.p.x) + (sinTheta * rec.p.z)
-                     , rec.p.y
-                     , (-sinTheta * rec.p.x) + (cosTheta * rec.p.z));
+    bool occluded(const Ray& r, Interval rayT) const override { return object->occluded(objectRay(r), rayT); }
 
-        rec.normal = glm::dvec3((cosTheta * rec.normal.x) + (sinTheta * rec.normal.z)
-                               , rec.normal.y
-                               , (-sinTheta * rec.normal.x) + (cosTheta * rec.normal.z));
+    double pdfValue(const Point& origin, const glm::dvec3& direction) const override
+    {
+        Ray rotated_r = objectRay(Ray(origin, direction));
+        return object->pdfValue(rotated_r.origin(), rotated_r.direction());
+    }
 
-        return true;
+    glm::dvec3 random(const Point& origin) const override
+    {
+        Ray rotated_r = objectRay(Ray(origin, glm::dvec3(0, 0, 0)));
+        return toWorld(object->random(rotated_r.origin()));
     }
 
     Aabb boundingBox() const override { return bbox; }
@@ -142,6 +241,42 @@ private:
     double sinTheta;
     double cosTheta;
     Aabb bbox;
+
+    void finalizeWrapped(const Ray& rotated_r, HitRecord& rec) const
+    {
+        rec.finalize(rotated_r);
+
+        // Transform the intersection from object space back to world space.
+
+        rec.p = toWorld(rec.p);
+        rec.normal = toWorld(rec.normal);
+        rec.dpdu = toWorld(rec.dpdu);
+        rec.dpdv = toWorld(rec.dpdv);
+    }
+
+    Ray objectRay(const Ray& r) const
+    {
+        // Transform the ray from world space to object space.
+
+        auto origin = Point((cosTheta * r.origin().x) - (sinTheta * r.origin().z)
+                            , r.origin().y
+                            , (sinTheta * r.origin().x) + (cosTheta * r.origin().z));
+
+        auto direction = glm::dvec3((cosTheta * r.direction().x) - (sinTheta * r.direction().z)
+                                    , r.direction().y
+                                    , (sinTheta * r.direction().x) + (cosTheta * r.direction().z));
+
+        return Ray(origin, direction, r.time());
+    }
+
+    glm::dvec3 toWorld(const glm::dvec3& v) const
+    {
+        // Transform a point or direction from object space back to world space.
+
+        return glm::dvec3((cosTheta * v.x) + (sinTheta * v.z)
+                          , v.y
+                          , (-sinTheta * v.x) + (cosTheta * v.z));
+    }
 };
 
 class RotateX : public Hittable
@@ -186,35 +321,36 @@ public:
 
     bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
     {
-
-        // Transform the ray from world space to object space.
-
-        auto origin = Point(r.origin().x
-                           , (cosTheta * r.origin().y) - (sinTheta * r.origin().z)
-                           , (sinTheta * r.origin().y) + (cosTheta * r.origin().z));
-
-        auto direction = glm::dvec3(r.direction().x
-                                   , (cosTheta * r.direction().y) - (sinTheta * r.direction().z)
-                                   , (sinTheta * r.direction().y) + (cosTheta * r.direction().z));
-
-        Ray rotated_r(origin, direction, r.time());
+        Ray rotated_r = objectRay(r);
 
         // Determine whether an intersection exists in object space (and if so, where).
 
-        if (!object->hit(rotated_r, rayT, rec))
+        if (!rec.hitWrapped(*object, rotated_r, rayT))
             return false;
+        if (!rec.deferWrapper(this))
+            finalizeWrapped(rotated_r, rec);
 
-        // Transform the intersection from object space back to world space.
+        return true;
+    }
 
-        rec.p = Point(rec.p.x
-                     , (cosTheta * rec.p.y) + (sinTheta * rec.p.z)
-                     , (-sinTheta * rec.p.y) + (cosTheta * rec.p.z));
+    void finalizeHit(const Ray& r, HitRecord& rec) const override
+    {
+        rec.unwrap();
+        finalizeWrapped(objectRay(r), rec);
+    }
 
-        rec.normal = glm::dvec3(rec.normal.x
-                               , (cosTheta * rec.normal.y) + (sinTheta * rec.normal.z)
-                               , (-sinTheta * rec.normal.y) + (cosTheta * rec.normal.z));
+    bool occluded(const Ray& r, Interval rayT) const override { return object->occluded(objectRay(r), rayT); }
 
-        return true;
+    double pdfValue(const Point& origin, const glm::dvec3& direction) const override
+    {
+        Ray rotated_r = objectRay(Ray(origin, direction));
+        return object->pdfValue(rotated_r.origin(), rotated_r.direction());
+    }
+
+    glm::dvec3 random(const Point& origin) const override
+    {
+        Ray rotated_r = objectRay(Ray(origin, glm::dvec3(0, 0, 0)));
+        return toWorld(object->random(rotated_r.origin()));
     }
 
     Aabb boundingBox() const override { return bbox; }
@@ -224,6 +360,42 @@ private:
     double sinTheta;
     double cosTheta;
     Aabb bbox;
+
+    void finalizeWrapped(const Ray& rotated_r, HitRecord& rec) const
+    {
+        rec.finalize(rotated_r);
+
+        // Transform the intersection from object space back to world space.
+
+        rec.p = toWorld(rec.p);
+        rec.normal = toWorld(rec.normal);
+        rec.dpdu = toWorld(rec.dpdu);
+        rec.dpdv = toWorld(rec.dpdv);
+    }
+
+    Ray objectRay(const Ray& r) const
+    {
+        // Transform the ray from world space to object space.
+
+        auto origin = Point(r.origin().x
+                           , (cosTheta * r.origin().y) - (sinTheta * r.origin().z)
+                           , (sinTheta * r.origin().y) + (cosTheta * r.origin().z));
+
+        auto direction = glm::dvec3(r.direction().x
+                                   , (cosTheta * r.direction().y) - (sinTheta * r.direction().z)
+                                   , (sinTheta * r.direction().y) + (cosTheta * r.direction().z));
+
+        return Ray(origin, direction, r.time());
+    }
+
+    glm::dvec3 toWorld(const glm::dvec3& v) const
+    {
+        // Transform a point or direction from object space back to world space.
+
+        return glm::dvec3(v.x
+                          , (cosTheta * v.y) + (sinTheta * v.z)
+                          , (-sinTheta * v.y) + (cosTheta * v.z));
+    }
 };
 
 class RotateZ : public Hittable
@@ -268,35 +440,36 @@ public:
 
     bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
     {
-
-        // Transform the ray from world space to object space.
-
-        auto origin = Point((cosTheta * r.origin().x) - (sinTheta * r.origin().y)
-                           , (sinTheta * r.origin().x) + (cosTheta * r.origin().y)
-                           , r.origin().z);
-
-        auto direction = glm::dvec3((cosTheta * r.direction().x) - (sinTheta * r.direction().y)
-                                   , (sinTheta * r.direction().x) + (cosTheta * r.direction().y)
-                                   , r.direction().z);
-
-        Ray rotated_r(origin, direction, r.time());
+        Ray rotated_r = objectRay(r);
 
         // Determine whether an intersection exists in object space (and if so, where).
 
-        if (!object->hit(rotated_r, rayT, rec))
+        if (!rec.hitWrapped(*object, rotated_r, rayT))
             return false;
+        if (!rec.deferWrapper(this))
+            finalizeWrapped(rotated_r, rec);
 
-        // Transform the intersection from object space back to world space.
+        return true;
+    }
 
-        rec.p = Point((cosTheta * rec.p.x) + (sinTheta * rec.p.y)
-                     , (-sinTheta * rec.p.x) + (cosTheta * rec.p.y)
-                     , rec.p.z);
+    void finalizeHit(const Ray& r, HitRecord& rec) const override
+    {
+        rec.unwrap();
+        finalizeWrapped(objectRay(r), rec);
+    }
 
-        rec.normal = glm::dvec3((cosTheta * rec.normal.x) + (sinTheta * rec.normal.y)
-                               , (-sinTheta * rec.normal.x) + (cosTheta * rec.normal.y)
-                               , rec.normal.z);
+    bool occluded(const Ray& r, Interval rayT) const override { return object->occluded(objectRay(r), rayT); }
 
-        return true;
+    double pdfValue(const Point& origin, const glm::dvec3& direction) const override
+    {
+        Ray rotated_r = objectRay(Ray(origin, direction));
+        return object->pdfValue(rotated_r.origin(), rotated_r.direction());
+    }
+
+    glm::dvec3 random(const Point& origin) const override
+    {
+        Ray rotated_r = objectRay(Ray(origin, glm::dvec3(0, 0, 0)));
+        return toWorld(object->random(rotated_r.origin()));
     }
 
     Aabb boundingBox() const override { return bbox; }
@@ -306,6 +479,42 @@ private:
     double sinTheta;
     double cosTheta;
     Aabb bbox;
+
+    void finalizeWrapped(const Ray& rotated_r, HitRecord& rec) const
+    {
+        rec.finalize(rotated_r);
+
+        // Transform the intersection from object space back to world space.
+
+        rec.p = toWorld(rec.p);
+        rec.normal = toWorld(rec.normal);
+        rec.dpdu = toWorld(rec.dpdu);
+        rec.dpdv = toWorld(rec.dpdv);
+    }
+
+    Ray objectRay(const Ray& r) const
+    {
+        // Transform the ray from world space to object space.
+
+        auto origin = Point((cosTheta * r.origin().x) - (sinTheta * r.origin().y)
+                           , (sinTheta * r.origin().x) + (cosTheta * r.origin().y)
+                           , r.origin().z);
+
+        auto direction = glm::dvec3((cosTheta * r.direction().x) - (sinTheta * r.direction().y)
+                                   , (sinTheta * r.direction().x) + (cosTheta * r.direction().y)
+                                   , r.direction().z);
+
+        return Ray(origin, direction, r.time());
+    }
+
+    glm::dvec3 toWorld(const glm::dvec3& v) const
+    {
+        // Transform a point or direction from object space back to world space.
+
+        return glm::dvec3((cosTheta * v.x) + (sinTheta * v.y)
+                          , (-sinTheta * v.x) + (cosTheta * v.y)
+                          , v.z);
+    }
 };
 
 #endif//_HITTABLE_H_
\ No newline at end of file
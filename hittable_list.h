@@ -41,6 +41,32 @@ public:
         return hitAnything;
     }
 
+    bool occluded(const Ray& r, Interval rayT) const override
+    {
+        for (const auto& object : objects)
+            if (object->occluded(r, rayT))
+                return true;
+        return false;
+    }
+
+    double pdfValue(const Point& origin, const glm::dvec3& direction) const override
+    {
+        // random() picks one of the objects uniformly, so the density is their average.
+        auto weight = 1.0 / objects.size();
+        auto sum = 0.0;
+
+        for (const auto& object : objects)
+            sum += weight * object->pdfValue(origin, direction);
+
+        return sum;
+    }
+
+    glm::dvec3 random(const Point& origin) const override
+    {
+        auto size = int(objects.size());
+        return objects[randomIntGen(0, size - 1)]->random(origin);
+    }
+
     Aabb boundingBox() const override { return bbox; }
 
 private:
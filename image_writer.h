@@ -0,0 +1,266 @@
+#ifndef _IMAGE_WRITER_H_
+#define _IMAGE_WRITER_H_
+
+#include "framebuffer.h"
+
+#include <algorithm> // std::min()
+#include <cstdint>
+#include <cstring> // std::memcpy()
+#include <fstream>
+#include <memory> // std::unique_ptr
+#include <sstream>
+#include <string>
+
+enum class ImageFormat
+{
+    PpmAscii, // Plain text P3 PPM, gamma 2, 8 bits per channel
+    Ppm,      // Binary P6 PPM, gamma 2, 8 bits per channel
+    Pfm,      // Portable float map, linear 32-bit float per channel
+    Png       // PNG, gamma 2, 8 bits per channel
+};
+
+class ImageEncoder
+{
+public:
+    virtual ~ImageEncoder() = default;
+
+    // Appends the complete encoded file to out.
+    virtual void encode(const Framebuffer& image, std::string& out) const = 0;
+};
+
+class PpmAsciiEncoder : public ImageEncoder
+{
+public:
+    void encode(const Framebuffer& image, std::string& out) const override
+    {
+        std::ostringstream text;
+        text << "P3\n" << image.width() << ' ' << image.height() << "\n255\n";
+
+        for (int y = 0; y < image.height(); y++)
+            for (int x = 0; x < image.width(); x++)
+                writeColor(text, image.get(x, y));
+
+        out += text.str();
+    }
+};
+
+class PpmEncoder : public ImageEncoder
+{
+public:
+    void encode(const Framebuffer& image, std::string& out) const override
+    {
+        out += "P6\n" + std::to_string(image.width()) + ' ' + std::to_string(image.height()) + "\n255\n";
+
+        auto offset = out.size();
+        auto count = size_t(image.width()) * image.height() * 3;
+        out.resize(offset + count);
+
+        const float* rgb = image.data();
+        for (size_t i = 0; i < count; i++)
+            out[offset + i] = char(linearToByte(rgb[i]));
+    }
+};
+
+class PfmEncoder : public ImageEncoder
+{
+public:
+    void encode(const Framebuffer& image, std::string& out) const override
+    {
+        // A negative scale marks little-endian data. PFM stores its rows from bottom to top.
+        out += "PF\n" + std::to_string(image.width()) + ' ' + std::to_string(image.height()) + "\n-1.0\n";
+
+        auto rowBytes = size_t(image.width()) * 3 * sizeof(float);
+        for (int y = image.height() - 1; y >= 0; y--)
+        {
+            const float* row = image.data() + size_t(y) * image.width() * 3;
+            auto offset = out.size();
+            out.resize(offset + rowBytes);
+
+            if (isLittleEndian())
+            {
+                std::memcpy(&out[offset], row, rowBytes);
+                continue;
+            }
+
+            for (size_t i = 0; i < size_t(image.width()) * 3; i++)
+            {
+                uint32_t bits;
+                std::memcpy(&bits, &row[i], sizeof(bits));
+                for (int b = 0; b < 4; b++)
+                    out[offset + i * 4 + b] = char((bits >> (8 * b)) & 0xff);
+            }
+        }
+    }
+
+private:
+    static bool isLittleEndian()
+    {
+        uint16_t probe = 1;
+        unsigned char first;
+        std::memcpy(&first, &probe, 1);
+        return first == 1;
+    }
+};
+
+class PngEncoder : public ImageEncoder
+{
+    // Self-contained PNG writer: 8-bit RGB, no filtering, and a zlib stream made of stored
+    // (uncompressed) deflate blocks, so it needs no compression library.
+
+public:
+    void encode(const Framebuffer& image, std::string& out) const override
+    {
+        static const char signature[] = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n'};
+        out.append(signature, sizeof(signature));
+
+        std::string header;
+        appendBigEndian(header, uint32_t(image.width()));
+        appendBigEndian(header, uint32_t(image.height()));
+        header += char(8); // Bit depth
+        header += char(2); // Color type: RGB
+        header += char(0); // Compression method: deflate
+        header += char(0); // Filter method: adaptive
+        header += char(0); // Interlace method: none
+        appendChunk(out, "IHDR", header);
+
+        // Raw scanlines, each prefixed with filter type 0 (none).
+        std::string raw;
+        raw.reserve(size_t(image.height()) * (size_t(image.width()) * 3 + 1));
+        const float* rgb = image.data();
+        for (int y = 0; y < image.height(); y++)
+        {
+            raw += char(0);
+            for (int i = 0; i < image.width() * 3; i++)
+                raw += char(linearToByte(*rgb++));
+        }
+
+        appendChunk(out, "IDAT", zlibStore(raw));
+        appendChunk(out, "IEND", std::string());
+    }
+
+private:
+    static void appendBigEndian(std::string& out, uint32_t value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out += char((value >> shift) & 0xff);
+    }
+
+    static uint32_t crc32(const std::string& bytes, size_t offset)
+    {
+        static uint32_t table[256];
+        static bool tableReady = [] {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            return true;
+        }();
+        (void)tableReady;
+
+        uint32_t crc = 0xffffffffu;
+        for (size_t i = offset; i < bytes.size(); i++)
+            crc = table[(crc ^ uint8_t(bytes[i])) & 0xff] ^ (crc >> 8);
+        return crc ^ 0xffffffffu;
+    }
+
+    static void appendChunk(std::string& out, const char* type, const std::string& data)
+    {
+        // The chunk CRC covers the type and the data, but not the length.
+        appendBigEndian(out, uint32_t(data.size()));
+        auto typeOffset = out.size();
+        out.append(type, 4);
+        out += data;
+        appendBigEndian(out, crc32(out, typeOffset));
+    }
+
+    static std::string zlibStore(const std::string& raw)
+    {
+        std::string stream;
+        stream += char(0x78); // CMF: deflate, 32K window
+        stream += char(0x01); // FLG: no dictionary, check bits
+
+        // Stored blocks carry at most 65535 bytes each.
+        size_t offset = 0;
+        do
+        {
+            auto length = std::min<size_t>(65535, raw.size() - offset);
+            bool last = offset + length == raw.size();
+            stream += char(last ? 1 : 0);
+            stream += char(length & 0xff);
+            stream += char((length >> 8) & 0xff);
+            stream += char(~length & 0xff);
+            stream += char((~length >> 8) & 0xff);
+            stream.append(raw, offset, length);
+            offset += length;
+        } while (offset < raw.size());
+
+        // Adler-32 checksum of the uncompressed data.
+        uint32_t a = 1, b = 0;
+        for (unsigned char byte : raw)
+        {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        appendBigEndian(stream, (b << 16) | a);
+
+        return stream;
+    }
+};
+
+inline std::unique_ptr<ImageEncoder> makeImageEncoder(ImageFormat format)
+{
+    switch (format)
+    {
+        case ImageFormat::PpmAscii: return std::make_unique<PpmAsciiEncoder>();
+        case ImageFormat::Pfm: return std::make_unique<PfmEncoder>();
+        case ImageFormat::Png: return std::make_unique<PngEncoder>();
+        case ImageFormat::Ppm:
+        default: return std::make_unique<PpmEncoder>();
+    }
+}
+
+inline ImageFormat imageFormatFromPath(const std::string& path, ImageFormat fallback)
+{
+    // Picks the format matching the file extension, or fallback for unknown extensions.
+    auto dot = path.rfind('.');
+    if (dot == std::string::npos)
+        return fallback;
+
+    auto extension = path.substr(dot + 1);
+    if (extension == "png")
+        return ImageFormat::Png;
+    if (extension == "pfm")
+        return ImageFormat::Pfm;
+    if (extension == "ppm")
+        return fallback == ImageFormat::PpmAscii ? ImageFormat::PpmAscii : ImageFormat::Ppm;
+    return fallback;
+}
+
+inline bool writeImage(const Framebuffer& image, ImageFormat format, const std::string& path)
+{
+    // Encodes the whole image into memory and writes it with a single call, either to the file
+    // at path or, when path is empty, to std::cout.
+
+    std::string encoded;
+    makeImageEncoder(format)->encode(image, encoded);
+
+    if (path.empty())
+    {
+        std::cout.write(encoded.data(), encoded.size());
+        std::cout.flush();
+        return bool(std::cout);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.write(encoded.data(), encoded.size()))
+    {
+        std::cerr << "ERROR: Could not write image file '" << path << "'.\n";
+        return false;
+    }
+    return true;
+}
+
+#endif//_IMAGE_WRITER_H_
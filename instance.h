@@ -0,0 +1,93 @@
+#ifndef _INSTANCE_H_
+#define _INSTANCE_H_
+
+#include "hittable.h"
+
+class Instance : public Hittable
+{
+    // One placement of a shared object under an affine transform. The object (typically a BVH,
+    // the bottom level) is kept once in memory however many instances point to it; the instances
+    // themselves go into another BVH (the top level). Unlike a chain of Translate/Rotate
+    // wrappers, the ray is transformed once with the precomputed inverse matrix, and the hit
+    // point and normal are transformed back once.
+
+public:
+    Instance(shared_ptr<Hittable> object, const glm::dmat4& transform)
+        : object(object), objectToWorld(glm::dmat4x3(transform)), worldToObject(glm::dmat4x3(glm::inverse(transform)))
+    {
+        // The world box encloses the eight transformed corners of the object's box.
+        auto objectBox = object->boundingBox();
+        Point min(INF, INF, INF);
+        Point max(-INF, -INF, -INF);
+
+        for (int i = 0; i < 2; i++)
+        {
+            for (int j = 0; j < 2; j++)
+            {
+                for (int k = 0; k < 2; k++)
+                {
+                    auto corner = transformPoint(objectToWorld, Point(i ? objectBox.x.max : objectBox.x.min,
+                                                                      j ? objectBox.y.max : objectBox.y.min,
+                                                                      k ? objectBox.z.max : objectBox.z.min));
+                    min = glm::min(min, corner);
+                    max = glm::max(max, corner);
+                }
+            }
+        }
+
+        bbox = Aabb(min, max);
+    }
+
+    bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+    {
+        // The object-space direction is not normalized, so ray distances stay the same in both
+        // spaces and rayT and rec.t need no conversion.
+
+        Ray objectRay = toObject(r);
+
+        if (!rec.hitWrapped(*object, objectRay, rayT))
+            return false;
+        if (!rec.deferWrapper(this))
+            finalizeWrapped(objectRay, rec);
+
+        return true;
+    }
+
+    void finalizeHit(const Ray& r, HitRecord& rec) const override
+    {
+        rec.unwrap();
+        finalizeWrapped(toObject(r), rec);
+    }
+
+    bool occluded(const Ray& r, Interval rayT) const override { return object->occluded(toObject(r), rayT); }
+
+    Aabb boundingBox() const override { return bbox; }
+
+private:
+    shared_ptr<Hittable> object;
+    glm::dmat4x3 objectToWorld; // 3x4 affine matrix: three linear columns and the translation
+    glm::dmat4x3 worldToObject;
+    Aabb bbox;
+
+    static Point transformPoint(const glm::dmat4x3& m, const Point& p) { return m[0] * p.x + m[1] * p.y + m[2] * p.z + m[3]; }
+
+    static glm::dvec3 transformVector(const glm::dmat4x3& m, const glm::dvec3& v) { return m[0] * v.x + m[1] * v.y + m[2] * v.z; }
+
+    Ray toObject(const Ray& r) const { return Ray(transformPoint(worldToObject, r.origin()), transformVector(worldToObject, r.direction()), r.time()); }
+
+    void finalizeWrapped(const Ray& objectRay, HitRecord& rec) const
+    {
+        rec.finalize(objectRay);
+
+        // Normals transform with the inverse transpose. That keeps the sign of dot(normal,
+        // direction), so frontFace set in object space still holds.
+        rec.p = transformPoint(objectToWorld, rec.p);
+        rec.normal = glm::normalize(glm::dvec3(glm::dot(worldToObject[0], rec.normal),
+                                               glm::dot(worldToObject[1], rec.normal),
+                                               glm::dot(worldToObject[2], rec.normal)));
+        rec.dpdu = transformVector(objectToWorld, rec.dpdu);
+        rec.dpdv = transformVector(objectToWorld, rec.dpdv);
+    }
+};
+
+#endif//_INSTANCE_H_
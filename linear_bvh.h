@@ -0,0 +1,322 @@
+#ifndef _LINEAR_BVH_H_
+#define _LINEAR_BVH_H_
+
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <algorithm> // std::sort(), std::nth_element()
+#include <cmath>     // std::nextafter()
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+struct alignas(32) LinearBvhNode
+{
+    // 32 bytes, aligned so that a node never straddles a cache line. The first child of an
+    // interior node is always the node right after it; only the second child's index is stored.
+
+    float boundsMin[3];      // Box minimum, rounded down to float
+    float boundsMax[3];      // Box maximum, rounded up to float
+    uint32_t offset;         // Leaf: first entry in the primitive index array. Interior: second child
+    uint16_t primitiveCount; // Number of primitives of a leaf, 0 for interior nodes
+    uint8_t axis;            // Split axis of an interior node, used to visit the near child first
+    uint8_t pad;
+
+    bool isLeaf() const { return primitiveCount > 0; }
+
+    bool hit(const Ray& r, Interval rayT) const
+    {
+        // Same slab test as Aabb::hit(): near and far planes picked by the direction sign, and
+        // every comparison ordered so that a NaN keeps the running value.
+
+        const Point& origin = r.origin();
+        const glm::dvec3& invDir = r.invDirection();
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            bool negative = r.dirIsNegative(axis);
+            double t0 = ((negative ? boundsMax[axis] : boundsMin[axis]) - origin[axis]) * invDir[axis];
+            double t1 = ((negative ? boundsMin[axis] : boundsMax[axis]) - origin[axis]) * invDir[axis];
+
+            rayT.min = t0 > rayT.min ? t0 : rayT.min;
+            rayT.max = t1 < rayT.max ? t1 : rayT.max;
+        }
+        return rayT.min < rayT.max;
+    }
+};
+
+static_assert(sizeof(LinearBvhNode) == 32, "LinearBvhNode should be 32 bytes");
+
+class LinearBvhTree
+{
+    // Bounding volume hierarchy flattened into one array of nodes in depth-first order. The tree
+    // only knows primitive indices and bounds; what a primitive is and how it is intersected is up
+    // to the owner, which passes a callback to traverse().
+
+public:
+    static const int stackSize = 64; // Traversal stack entries; the builder keeps the depth below it
+
+    void build(const std::vector<Aabb>& primitiveBounds, const BvhBuildOptions& options = BvhBuildOptions())
+    {
+        bounds = &primitiveBounds;
+        buildOptions = options;
+
+        nodes.clear();
+        primitiveIndices.resize(primitiveBounds.size());
+        for (size_t i = 0; i < primitiveIndices.size(); i++)
+            primitiveIndices[i] = uint32_t(i);
+
+        if (!primitiveBounds.empty())
+        {
+            nodes.reserve(2 * primitiveBounds.size());
+            buildRecursive(nodes, 0, uint32_t(primitiveBounds.size()), 0, bvhBuildThreads(options));
+        }
+
+        bounds = nullptr;
+    }
+
+    template <bool anyHit = false, typename IntersectFn>
+    bool traverse(const Ray& r, Interval rayT, IntersectFn&& intersect) const
+    {
+        // Visits the leaves whose boxes the ray enters, nearest child first, and calls
+        // intersect(primitiveIndex, rayT) for their primitives. The callback returns true on a
+        // hit and then shrinks rayT.max to the hit distance, which prunes the rest of the walk.
+        // With anyHit, the walk ends at the first hit instead (occlusion queries).
+
+        if (nodes.empty())
+            return false;
+
+        uint32_t stack[stackSize];
+        int stackTop = 0;
+        uint32_t current = 0;
+        bool hitAnything = false;
+
+        while (true)
+        {
+            const LinearBvhNode& node = nodes[current];
+            if (node.hit(r, rayT))
+            {
+                if (node.isLeaf())
+                {
+                    for (uint32_t i = 0; i < node.primitiveCount; i++)
+                    {
+                        if (intersect(primitiveIndices[node.offset + i], rayT))
+                        {
+                            if (anyHit)
+                                return true;
+                            hitAnything = true;
+                        }
+                    }
+                }
+                else
+                {
+                    // Push the far child and descend into the near one.
+                    if (r.dirIsNegative(node.axis))
+                    {
+                        stack[stackTop++] = current + 1;
+                        current = node.offset;
+                    }
+                    else
+                    {
+                        stack[stackTop++] = node.offset;
+                        current = current + 1;
+                    }
+                    continue;
+                }
+            }
+
+            if (stackTop == 0)
+                break;
+            current = stack[--stackTop];
+        }
+
+        return hitAnything;
+    }
+
+    Aabb boundingBox() const
+    {
+        if (nodes.empty())
+            return Aabb::empty;
+        const auto& root = nodes[0];
+        return Aabb(Point(root.boundsMin[0], root.boundsMin[1], root.boundsMin[2]), Point(root.boundsMax[0], root.boundsMax[1], root.boundsMax[2]));
+    }
+
+    double sahCost(const BvhBuildOptions& options = BvhBuildOptions()) const { return nodes.empty() ? 0 : nodeCost(0, options); }
+
+    size_t nodeCount() const { return nodes.size(); }
+
+    const std::vector<LinearBvhNode>& nodeArray() const { return nodes; }
+    const std::vector<uint32_t>& primitiveIndexArray() const { return primitiveIndices; }
+
+private:
+    std::vector<LinearBvhNode> nodes;
+    std::vector<uint32_t> primitiveIndices;
+
+    // Build state
+    const std::vector<Aabb>* bounds = nullptr;
+    BvhBuildOptions buildOptions;
+
+    static const int maxSahDepth = 40;         // Past this depth spans are halved, bounding the stack use
+    static const int maxDepth = stackSize - 1; // Nodes this deep are always leaves, so traversal never overflows its stack
+    static_assert(maxSahDepth < maxDepth, "the SAH split must stop before the depth cap");
+
+    static float roundDown(double value)
+    {
+        auto f = float(value);
+        return double(f) > value ? std::nextafter(f, -INFINITY) : f;
+    }
+
+    static float roundUp(double value)
+    {
+        auto f = float(value);
+        return double(f) < value ? std::nextafter(f, INFINITY) : f;
+    }
+
+    uint32_t buildRecursive(std::vector<LinearBvhNode>& out, uint32_t start, uint32_t end, int depth, int threads)
+    {
+        // Appends the subtree over primitiveIndices[start, end) to out and returns its root index.
+
+        auto nodeIndex = uint32_t(out.size());
+        out.emplace_back();
+
+        const auto& primitiveBounds = *bounds;
+        Aabb bbox = Aabb::empty;
+        for (auto i = start; i < end; i++)
+            bbox = Aabb(bbox, primitiveBounds[primitiveIndices[i]]);
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            out[nodeIndex].boundsMin[axis] = roundDown(bbox.axisInterval(axis).min);
+            out[nodeIndex].boundsMax[axis] = roundUp(bbox.axisInterval(axis).max);
+        }
+
+        auto first = primitiveIndices.begin() + start;
+        auto last = primitiveIndices.begin() + end;
+        auto count = end - start;
+        auto boundsOf = [&](uint32_t index) -> const Aabb& { return primitiveBounds[index]; };
+
+        // Traversal pushes one entry per interior node on the way down, so a leaf is forced at
+        // maxDepth. The spans halve from maxSahDepth on, so even 2^32 primitives are down to a
+        // few hundred by then, well within a leaf's count.
+        auto split = last;
+        int axis = bbox.longestAxis();
+        if (buildOptions.method == BvhSplitMethod::Sah && depth < maxSahDepth)
+        {
+            if (count > 1)
+                split = sahPartition(first, last, bbox, boundsOf, buildOptions, threads, &axis);
+        }
+        else if (count > 2 && depth < maxDepth)
+        {
+            // Median split: order by box minimum along the longest axis and halve the span.
+            split = first + count / 2;
+            std::nth_element(first, split, last, [&](uint32_t a, uint32_t b) {
+                return primitiveBounds[a].axisInterval(axis).min < primitiveBounds[b].axisInterval(axis).min;
+            });
+        }
+
+        if (split == last)
+        {
+            out[nodeIndex].offset = start;
+            out[nodeIndex].primitiveCount = uint16_t(count);
+            return nodeIndex;
+        }
+
+        auto mid = start + uint32_t(split - first);
+        out[nodeIndex].axis = uint8_t(axis);
+
+        if (threads > 1 && count >= buildOptions.parallelMinObjects)
+        {
+            // Build both subtrees at once into arrays of their own, then splice them in behind
+            // this node, shifting their child links by where they land.
+            std::vector<LinearBvhNode> leftNodes, rightNodes;
+            std::thread leftBuilder([&] { buildRecursive(leftNodes, start, mid, depth + 1, threads / 2); });
+            buildRecursive(rightNodes, mid, end, depth + 1, threads - threads / 2);
+            leftBuilder.join();
+
+            append(out, leftNodes);
+            out[nodeIndex].offset = append(out, rightNodes);
+            return nodeIndex;
+        }
+
+        buildRecursive(out, start, mid, depth + 1, 1);
+        out[nodeIndex].offset = buildRecursive(out, mid, end, depth + 1, 1);
+        return nodeIndex;
+    }
+
+    static uint32_t append(std::vector<LinearBvhNode>& out, const std::vector<LinearBvhNode>& subtree)
+    {
+        // Appends a subtree built on its own and returns the index its root landed at.
+        auto base = uint32_t(out.size());
+        for (auto node : subtree)
+        {
+            if (!node.isLeaf())
+                node.offset += base;
+            out.push_back(node);
+        }
+        return base;
+    }
+
+    Aabb nodeBox(uint32_t index) const
+    {
+        const auto& node = nodes[index];
+        return Aabb(Interval(node.boundsMin[0], node.boundsMax[0]), Interval(node.boundsMin[1], node.boundsMax[1]),
+                    Interval(node.boundsMin[2], node.boundsMax[2]));
+    }
+
+    double nodeCost(uint32_t index, const BvhBuildOptions& options) const
+    {
+        const auto& node = nodes[index];
+        if (node.isLeaf())
+            return options.intersectionCost * node.primitiveCount;
+
+        auto invArea = 1.0 / std::max(nodeBox(index).surfaceArea(), 1e-12);
+        return options.traversalCost + invArea * (nodeBox(index + 1).surfaceArea() * nodeCost(index + 1, options) +
+                                                  nodeBox(node.offset).surfaceArea() * nodeCost(node.offset, options));
+    }
+};
+
+class LinearBvh : public Hittable
+{
+public:
+    LinearBvh(const HittableList& list, const BvhBuildOptions& options = BvhBuildOptions()) : objects(list.objects)
+    {
+        std::vector<Aabb> objectBounds;
+        objectBounds.reserve(objects.size());
+        for (const auto& object : objects)
+            objectBounds.push_back(object->boundingBox());
+
+        Timer buildTimer;
+        tree.build(objectBounds, options);
+        bbox = tree.boundingBox();
+
+        std::clog << "Linear BVH over " << objects.size() << " objects, " << tree.nodeCount() << " nodes ("
+                  << (options.method == BvhSplitMethod::Sah ? "SAH" : "median") << " split) built in " << buildTimer.seconds()
+                  << " s, SAH cost " << tree.sahCost(options) << '\n';
+    }
+
+    bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+    {
+        return tree.traverse(r, rayT, [&](uint32_t index, Interval& t) {
+            if (!objects[index]->hit(r, t, rec))
+                return false;
+            t.max = rec.t;
+            return true;
+        });
+    }
+
+    bool occluded(const Ray& r, Interval rayT) const override
+    {
+        return tree.traverse<true>(r, rayT, [&](uint32_t index, Interval& t) { return objects[index]->occluded(r, t); });
+    }
+
+    Aabb boundingBox() const override { return bbox; }
+
+private:
+    std::vector<shared_ptr<Hittable>> objects;
+    LinearBvhTree tree;
+    Aabb bbox;
+};
+
+#endif//_LINEAR_BVH_H_
@@ -0,0 +1,102 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RT_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile
+{
+    // A read-only view of a whole file. On POSIX systems the file is memory mapped, so opening
+    // it reads nothing and the OS pages the data in as it is touched. Elsewhere the file is read
+    // into memory in one go. Either way the data starts on a 64 byte boundary.
+
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path)
+    {
+        close();
+
+#ifdef RT_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* address = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping stays valid after the descriptor is closed.
+        if (address == MAP_FAILED)
+            return false;
+
+        mapped = static_cast<const char*>(address);
+        mappedSize = size_t(info.st_size);
+        return true;
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+
+        auto fileSize = size_t(file.tellg());
+        buffer.resize((fileSize + sizeof(Block) - 1) / sizeof(Block));
+        file.seekg(0);
+        if (fileSize == 0 || !file.read(reinterpret_cast<char*>(buffer.data()), fileSize))
+        {
+            buffer.clear();
+            return false;
+        }
+
+        mapped = reinterpret_cast<const char*>(buffer.data());
+        mappedSize = fileSize;
+        return true;
+#endif
+    }
+
+    void close()
+    {
+#ifdef RT_HAVE_MMAP
+        if (mapped != nullptr)
+            munmap(const_cast<char*>(mapped), mappedSize);
+#else
+        buffer.clear();
+        buffer.shrink_to_fit();
+#endif
+        mapped = nullptr;
+        mappedSize = 0;
+    }
+
+    const char* data() const { return mapped; }
+    size_t size() const { return mappedSize; }
+
+private:
+    const char* mapped = nullptr;
+    size_t mappedSize = 0;
+#ifndef RT_HAVE_MMAP
+    struct alignas(64) Block
+    {
+        char bytes[64];
+    };
+    std::vector<Block> buffer;
+#endif
+};
+
+#endif//_MAPPED_FILE_H_
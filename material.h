@@ -4,36 +4,71 @@
 #include "hittable.h"
 #include "texture.h"
 
+struct ScatterSample
+{
+    Ray scattered; // Continuation of the path
+    Color weight;  // eval() / pdf() of the sampled direction: the factor the path throughput takes on
+    double pdf;    // Solid angle density of the sampled direction, 0 for specular scattering
+};
+
 class Material
 {
+    // Scattering is described by three functions of the outgoing direction: sample() picks one,
+    // eval() gives the scattered fraction of the light arriving from it (the BSDF times the
+    // cosine to the normal, or the phase function in a medium), and pdf() the density with which
+    // sample() picks it. Specular materials scatter into single directions that cannot be hit by
+    // chance; their eval() and pdf() are 0 and only sample() applies.
+
 public:
     virtual ~Material() = default;
 
     virtual Color emitted(double u, double v, const Point& p) const { return Color(0, 0, 0); }
 
-    virtual bool scatter(const Ray& rayIn, const HitRecord& rec, Color& attenuation, Ray& scattered) const { return false; }
+    // Returns false if the path is absorbed.
+    virtual bool sample(const Ray& rayIn, const HitRecord& rec, ScatterSample& s) const { return false; }
+
+    virtual Color eval(const Ray& rayIn, const HitRecord& rec, const glm::dvec3& direction) const { return Color(0, 0, 0); }
+
+    virtual double pdf(const Ray& rayIn, const HitRecord& rec, const glm::dvec3& direction) const { return 0; }
+
+    // Color of the surface at rec, independent of any direction (the albedo output image).
+    virtual Color baseColor(const HitRecord& rec) const { return Color(0, 0, 0); }
 };
 
 class Lambertian : public Material
 {
 public:
-    Lambertian(const Color& albedo) : tex(make_shared<SolidColor>(albedo)) {}
-    Lambertian(shared_ptr<Texture> tex) : tex(tex) {}
+    Lambertian(const Color& albedo) : tex(textureTable().add(make_shared<SolidColor>(albedo))) {}
+    Lambertian(shared_ptr<Texture> tex) : tex(textureTable().add(tex)) {}
 
-    bool scatter(const Ray& rayIn, const HitRecord& rec, Color& attenuation, Ray& scattered) const override
+    bool sample(const Ray& rayIn, const HitRecord& rec, ScatterSample& s) const override
     {
-        auto scatterDirection = rec.normal + randomUnitVectorGen();
+        // Directions are drawn with the cosine distribution of the BSDF itself, so the weight
+        // of every sample is just the albedo.
+        Onb uvw(rec.normal);
+        auto direction = uvw.transform(randomCosineDirection());
+
+        s.scattered = Ray(rec.p, direction, rayIn.time());
+        s.weight = textureTable()[tex].value(rec.u, rec.v, rec.p, rec.footprint);
+        s.pdf = glm::dot(rec.normal, direction) / PI;
+        return true;
+    }
 
-        // Catch degenerate scatter direction
-        if (nearZero(scatterDirection)) scatterDirection = rec.normal;
+    Color eval(const Ray& rayIn, const HitRecord& rec, const glm::dvec3& direction) const override
+    {
+        return textureTable()[tex].value(rec.u, rec.v, rec.p, rec.footprint) * pdf(rayIn, rec, direction);
+    }
 
-        scattered = Ray(rec.p, scatterDirection, rayIn.time());
-        attenuation = tex->value(rec.u, rec.v, rec.p);
-        return true;
+    double pdf(const Ray& rayIn, const HitRecord& rec, const glm::dvec3& direction) const override
+    {
+        auto cosTheta = glm::dot(rec.normal, glm::normalize(direction));
+        return cosTheta < 0 ? 0 : cosTheta / PI;
     }
 
+    Color baseColor(const HitRecord& rec) const override { return textureTable()[tex].value(rec.u, rec.v, rec.p, rec.footprint); }
+
 private:
-    shared_ptr<Texture> tex;
+    TextureId tex;
 };
 
 class Metal : public Material
@@ -41,15 +76,20 @@ class Metal : public Material
 public:
     Metal(const Color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
 
-    bool scatter(const Ray& rayIn, const HitRecord& rec, Color& attenuation, Ray& scattered) const override
+    bool sample(const Ray& rayIn, const HitRecord& rec, ScatterSample& s) const override
     {
+        // The fuzz perturbs the mirror direction without a known density, so even fuzzy metal
+        // counts as specular.
         glm::dvec3 reflected = reflect(rayIn.direction(), rec.normal);
         reflected = glm::normalize(reflected) + (fuzz * randomUnitVectorGen());
-        scattered = Ray(rec.p, reflected, rayIn.time());
-        attenuation = albedo;
-        return (glm::dot(scattered.direction(), rec.normal) > 0);
+        s.scattered = Ray(rec.p, reflected, rayIn.time());
+        s.weight = albedo;
+        s.pdf = 0;
+        return (glm::dot(s.scattered.direction(), rec.normal) > 0);
     }
 
+    Color baseColor(const HitRecord& rec) const override { return albedo; }
+
 private:
     Color albedo;
     double fuzz;
@@ -60,9 +100,10 @@ class Dielectric : public Material
 public:
     Dielectric(double refractionIndex) : refractionIndex(refractionIndex) {}
 
-    bool scatter(const Ray& rayIn, const HitRecord& rec, Color& attenuation, Ray& scattered) const override
+    bool sample(const Ray& rayIn, const HitRecord& rec, ScatterSample& s) const override
     {
-        attenuation = Color(1.0, 1.0, 1.0);
+        s.weight = Color(1.0, 1.0, 1.0);
+        s.pdf = 0;
         double ri = rec.frontFace ? (1.0 / refractionIndex) : refractionIndex;
 
         glm::dvec3 unitDirection = glm::normalize(rayIn.direction());
@@ -77,10 +118,12 @@ public:
         else
             direction = refract(unitDirection, rec.normal, ri);
 
-        scattered = Ray(rec.p, direction, rayIn.time());
+        s.scattered = Ray(rec.p, direction, rayIn.time());
         return true;
     }
 
+    Color baseColor(const HitRecord& rec) const override { return Color(1, 1, 1); }
+
 private:
     // Refractive index in vacuum or air, or the ratio of the Material's refractive index over
     // the refractive index of the enclosing media
@@ -98,30 +141,40 @@ private:
 class DiffuseLight : public Material
 {
 public:
-    DiffuseLight(shared_ptr<Texture> tex) : tex(tex) {}
-    DiffuseLight(const Color& emit) : tex(make_shared<SolidColor>(emit)) {}
+    DiffuseLight(shared_ptr<Texture> tex) : tex(textureTable().add(tex)) {}
+    DiffuseLight(const Color& emit) : tex(textureTable().add(make_shared<SolidColor>(emit))) {}
 
-    Color emitted(double u, double v, const Point& p) const override { return tex->value(u, v, p); }
+    Color emitted(double u, double v, const Point& p) const override { return textureTable()[tex].value(u, v, p, glm::dvec2(0, 0)); }
 
 private:
-    shared_ptr<Texture> tex;
+    TextureId tex;
 };
 
 class Isotropic : public Material
 {
 public:
-    Isotropic(const Color& albedo) : tex(make_shared<SolidColor>(albedo)) {}
-    Isotropic(shared_ptr<Texture> tex) : tex(tex) {}
+    Isotropic(const Color& albedo) : tex(textureTable().add(make_shared<SolidColor>(albedo))) {}
+    Isotropic(shared_ptr<Texture> tex) : tex(textureTable().add(tex)) {}
 
-    bool scatter(const Ray& rayIn, const HitRecord& rec, Color& attenuation, Ray& scattered) const override
+    bool sample(const Ray& rayIn, const HitRecord& rec, ScatterSample& s) const override
     {
-        scattered = Ray(rec.p, randomUnitVectorGen(), rayIn.time());
-        attenuation = tex->value(rec.u, rec.v, rec.p);
+        s.scattered = Ray(rec.p, randomUnitVectorGen(), rayIn.time());
+        s.weight = textureTable()[tex].value(rec.u, rec.v, rec.p, rec.footprint);
+        s.pdf = 1 / (4 * PI);
         return true;
     }
 
+    Color eval(const Ray& rayIn, const HitRecord& rec, const glm::dvec3& direction) const override
+    {
+        return textureTable()[tex].value(rec.u, rec.v, rec.p, rec.footprint) / (4 * PI);
+    }
+
+    double pdf(const Ray& rayIn, const HitRecord& rec, const glm::dvec3& direction) const override { return 1 / (4 * PI); }
+
+    Color baseColor(const HitRecord& rec) const override { return textureTable()[tex].value(rec.u, rec.v, rec.p, rec.footprint); }
+
 private:
-    shared_ptr<Texture> tex;
+    TextureId tex;
 };
 
 #endif//_MATERIAL_H_
\ No newline at end of file
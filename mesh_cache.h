@@ -0,0 +1,420 @@
+#ifndef _MESH_CACHE_H_
+#define _MESH_CACHE_H_
+
+#include "mapped_file.h"
+#include "mesh_loader.h"
+#include "triangle_mesh.h"
+
+#include <algorithm> // std::max()
+#include <cstdint>
+#include <cstdio> // std::rename(), std::remove()
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A mesh cache file holds everything TriangleMesh needs from a mesh file, ready to use: the
+// flat vertex and index arrays, the material slots with their texture references, and the
+// built wide BVH nodes. Each array starts on a 64 byte boundary, so once the file is mapped the
+// arrays are used in place, with nothing to parse and nothing to allocate per node or vertex.
+// The header records the size and modification time of the mesh file and of the material
+// libraries it named, and the BVH build options; if any of them changed, the cache is stale and
+// gets rebuilt. A cache whose indices point outside its own arrays is rebuilt as well. Like
+// checkpoints, the cache is in the byte order of the machine that wrote it.
+
+struct MeshCacheSection
+{
+    uint64_t offset = 0; // From the start of the file, a multiple of 64
+    uint64_t size = 0;   // In bytes, 0 for an absent array
+};
+
+struct MeshCacheHeader
+{
+    uint32_t magic = 0x434d5452; // "RTMC"
+    uint32_t version = 2;
+    uint32_t byteOrder = 0x01020304;
+    uint32_t nodeSize = sizeof(WideBvhNode);
+
+    uint64_t sourceSize = 0; // Mesh file the cache was made from
+    int64_t sourceTime = 0;
+    uint64_t librariesStamp = 0; // librariesStamp() of the material libraries listed in libraryNames
+
+    uint32_t splitMethod = 0; // BVH build options the nodes were built with
+    uint32_t binCount = 0;
+    uint32_t maxLeafSize = 0;
+    uint32_t pad = 0;
+    double traversalCost = 0;
+    double intersectionCost = 0;
+
+    uint64_t vertexCount = 0;
+    uint64_t triangleCount = 0;
+    uint64_t nodeCount = 0;
+    uint64_t primitiveIndexCount = 0;
+    uint64_t slotCount = 0;
+    uint64_t libraryCount = 0;
+
+    MeshCacheSection positions, normals, uvs, indices, triangleSlots, nodes, primitiveIndices;
+    MeshCacheSection slotNames;    // Name and texture of every slot, each terminated by '\0'
+    MeshCacheSection libraryNames; // Path of every material library, each terminated by '\0'
+    uint64_t fileSize = 0;
+
+    void setOptions(const BvhBuildOptions& options)
+    {
+        splitMethod = uint32_t(options.method);
+        binCount = uint32_t(options.binCount);
+        maxLeafSize = uint32_t(options.maxLeafSize);
+        traversalCost = options.traversalCost;
+        intersectionCost = options.intersectionCost;
+    }
+
+    bool matches(const MeshCacheHeader& expected) const
+    {
+        return magic == expected.magic && version == expected.version && byteOrder == expected.byteOrder &&
+               nodeSize == expected.nodeSize && sourceSize == expected.sourceSize && sourceTime == expected.sourceTime &&
+               splitMethod == expected.splitMethod && binCount == expected.binCount && maxLeafSize == expected.maxLeafSize &&
+               traversalCost == expected.traversalCost && intersectionCost == expected.intersectionCost;
+    }
+};
+
+namespace mesh_cache_detail
+{
+inline bool sourceStamp(const std::string& path, MeshCacheHeader& header)
+{
+    // Fills in the size and modification time of the mesh file.
+    std::error_code error;
+    auto size = std::filesystem::file_size(path, error);
+    if (error)
+        return false;
+    auto time = std::filesystem::last_write_time(path, error);
+    if (error)
+        return false;
+
+    header.sourceSize = size;
+    header.sourceTime = int64_t(time.time_since_epoch().count());
+    return true;
+}
+
+inline uint64_t librariesStamp(const std::vector<std::string>& paths)
+{
+    // Hashes the path, size and modification time of every material library. A library that
+    // cannot be read hashes as such, so it appearing later changes the stamp too.
+    uint64_t hash = hashBytes(nullptr, 0);
+    for (const auto& path : paths)
+    {
+        MeshCacheHeader stamp;
+        bool found = sourceStamp(path, stamp);
+        hash = hashBytes(path.data(), path.size() + 1, hash);
+        hash = hashBytes(&found, sizeof(found), hash);
+        hash = hashBytes(&stamp.sourceSize, sizeof(stamp.sourceSize), hash);
+        hash = hashBytes(&stamp.sourceTime, sizeof(stamp.sourceTime), hash);
+    }
+    return hash;
+}
+
+inline bool splitNames(const char* names, const char* namesEnd, uint64_t count, std::vector<std::string>& out)
+{
+    // Reads count strings, each terminated by '\0', from [names, namesEnd).
+    out.clear();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        auto end = static_cast<const char*>(std::memchr(names, '\0', size_t(namesEnd - names)));
+        if (end == nullptr)
+            return false;
+        out.emplace_back(names, end);
+        names = end + 1;
+    }
+    return true;
+}
+
+inline uint64_t alignSection(uint64_t offset) { return (offset + 63) & ~uint64_t(63); }
+
+inline bool sectionFits(const MeshCacheSection& section, uint64_t expectedSize, uint64_t fileSize)
+{
+    return section.size == expectedSize && section.offset % 64 == 0 && section.offset <= fileSize && section.size <= fileSize - section.offset;
+}
+} // namespace mesh_cache_detail
+
+class MeshCache
+{
+    // A mapped mesh cache file. The views it hands out point into the mapping.
+
+public:
+    bool open(const std::string& cachePath, const MeshCacheHeader& expected)
+    {
+        // Maps the cache and checks it against the expected source stamp and build options, and
+        // that every array lies inside the file. Returns false if the cache is missing or stale.
+        using namespace mesh_cache_detail;
+
+        if (!file.open(cachePath))
+            return false;
+
+        if (file.size() < sizeof(MeshCacheHeader))
+            return close();
+
+        std::memcpy(&header, file.data(), sizeof(MeshCacheHeader));
+        auto size = uint64_t(file.size());
+        bool hasNormals = header.normals.size > 0, hasUvs = header.uvs.size > 0, hasSlots = header.triangleSlots.size > 0;
+
+        if (!header.matches(expected) || header.fileSize != size ||
+            !sectionFits(header.positions, 12 * header.vertexCount, size) ||
+            !sectionFits(header.normals, hasNormals ? 12 * header.vertexCount : 0, size) ||
+            !sectionFits(header.uvs, hasUvs ? 8 * header.vertexCount : 0, size) ||
+            !sectionFits(header.indices, 12 * header.triangleCount, size) ||
+            !sectionFits(header.triangleSlots, hasSlots ? 2 * header.triangleCount : 0, size) ||
+            !sectionFits(header.nodes, header.nodeCount * sizeof(WideBvhNode), size) ||
+            !sectionFits(header.primitiveIndices, 4 * header.primitiveIndexCount, size) ||
+            !sectionFits(header.slotNames, header.slotNames.size, size) ||
+            !sectionFits(header.libraryNames, header.libraryNames.size, size))
+            return close();
+
+        // Slot and library names are the one part that is copied out, being a handful of short
+        // strings. The libraries are stamped again now to see whether they changed.
+        std::vector<std::string> names, libraries;
+        const char* slotNames = file.data() + header.slotNames.offset;
+        const char* libraryNames = file.data() + header.libraryNames.offset;
+        if (!splitNames(slotNames, slotNames + header.slotNames.size, 2 * header.slotCount, names) ||
+            !splitNames(libraryNames, libraryNames + header.libraryNames.size, header.libraryCount, libraries) ||
+            librariesStamp(libraries) != header.librariesStamp)
+            return close();
+
+        slots.clear();
+        for (uint64_t i = 0; i < header.slotCount; i++)
+            slots.push_back(MeshMaterialSlot{names[2 * i], names[2 * i + 1]});
+
+        if (!indicesValid())
+            return close();
+        return true;
+    }
+
+    MeshView view() const
+    {
+        MeshView view;
+        view.positions = array<float>(header.positions);
+        view.normals = array<float>(header.normals);
+        view.uvs = array<float>(header.uvs);
+        view.indices = array<uint32_t>(header.indices);
+        view.triangleSlots = array<uint16_t>(header.triangleSlots);
+        view.vertexCount = size_t(header.vertexCount);
+        view.triangleCount = size_t(header.triangleCount);
+        return view;
+    }
+
+    WideBvhTree tree() const
+    {
+        WideBvhTree tree;
+        tree.attach(array<WideBvhNode>(header.nodes), size_t(header.nodeCount), array<uint32_t>(header.primitiveIndices), size_t(header.primitiveIndexCount));
+        return tree;
+    }
+
+    const std::vector<MeshMaterialSlot>& materialSlots() const { return slots; }
+
+private:
+    MappedFile file;
+    MeshCacheHeader header;
+    std::vector<MeshMaterialSlot> slots;
+
+    bool close()
+    {
+        file.close();
+        return false;
+    }
+
+    bool indicesValid() const
+    {
+        // Checks every index the mesh and tree follow against the array it points into, so a
+        // corrupt cache is rebuilt instead of read out of bounds. One pass over the arrays, far
+        // cheaper than building them.
+        const uint32_t* indices = array<uint32_t>(header.indices);
+        for (uint64_t i = 0; i < 3 * header.triangleCount; i++)
+            if (indices[i] >= header.vertexCount)
+                return false;
+
+        const uint32_t* primitiveIndices = array<uint32_t>(header.primitiveIndices);
+        for (uint64_t i = 0; i < header.primitiveIndexCount; i++)
+            if (primitiveIndices[i] >= header.triangleCount)
+                return false;
+
+        // Interior children always come after their parent in the node array, so a parent's
+        // depth is known before its children are reached; no deeper than the builder makes
+        // them, they fit the traversal stack.
+        const WideBvhNode* nodes = array<WideBvhNode>(header.nodes);
+        std::vector<uint8_t> depth(size_t(header.nodeCount), 0);
+        for (uint64_t n = 0; n < header.nodeCount; n++)
+        {
+            for (int c = 0; c < WideBvhNode::width; c++)
+            {
+                auto child = uint64_t(nodes[n].child[c]);
+                if (child == WideBvhNode::emptySlot)
+                    continue;
+
+                if (nodes[n].count[c] > 0)
+                {
+                    if (child + nodes[n].count[c] > header.primitiveIndexCount)
+                        return false;
+                }
+                else
+                {
+                    if (child <= n || child >= header.nodeCount || depth[n] + 1 >= LinearBvhTree::stackSize)
+                        return false;
+                    depth[child] = std::max(depth[child], uint8_t(depth[n] + 1));
+                }
+            }
+        }
+        return true;
+    }
+
+    template <typename T>
+    const T* array(const MeshCacheSection& section) const
+    {
+        return section.size > 0 ? reinterpret_cast<const T*>(file.data() + section.offset) : nullptr;
+    }
+};
+
+inline bool saveMeshCache(const std::string& cachePath, const MeshCacheHeader& stamp, const TriangleMesh& mesh, const std::vector<MeshMaterialSlot>& slots,
+                          const std::vector<std::string>& libraries)
+{
+    // Writes the mesh and its tree to a temporary file and renames it over cachePath once it is
+    // complete, so a crash mid-write never leaves a truncated cache behind.
+    using namespace mesh_cache_detail;
+
+    const auto& view = mesh.meshView();
+    const auto& tree = mesh.bvh();
+
+    MeshCacheHeader header = stamp;
+    header.vertexCount = view.vertexCount;
+    header.triangleCount = view.triangleCount;
+    header.nodeCount = tree.nodeCount();
+    header.primitiveIndexCount = tree.primitiveIndexCount();
+    header.slotCount = slots.size();
+    header.libraryCount = libraries.size();
+    header.librariesStamp = librariesStamp(libraries);
+
+    std::string names;
+    for (const auto& slot : slots)
+    {
+        names += slot.name;
+        names += '\0';
+        names += slot.texture;
+        names += '\0';
+    }
+
+    std::string libraryNames;
+    for (const auto& library : libraries)
+    {
+        libraryNames += library;
+        libraryNames += '\0';
+    }
+
+    struct Part
+    {
+        MeshCacheSection* section;
+        const void* data;
+        uint64_t size;
+    };
+
+    Part parts[] = {
+        {&header.positions, view.positions, 12 * header.vertexCount},
+        {&header.normals, view.normals, view.normals != nullptr ? 12 * header.vertexCount : 0},
+        {&header.uvs, view.uvs, view.uvs != nullptr ? 8 * header.vertexCount : 0},
+        {&header.indices, view.indices, 12 * header.triangleCount},
+        {&header.triangleSlots, view.triangleSlots, view.triangleSlots != nullptr ? 2 * header.triangleCount : 0},
+        {&header.nodes, tree.nodeData(), header.nodeCount * sizeof(WideBvhNode)},
+        {&header.primitiveIndices, tree.primitiveIndexData(), 4 * header.primitiveIndexCount},
+        {&header.slotNames, names.data(), names.size()},
+        {&header.libraryNames, libraryNames.data(), libraryNames.size()},
+    };
+
+    uint64_t offset = alignSection(sizeof(MeshCacheHeader));
+    for (auto& part : parts)
+    {
+        part.section->offset = offset;
+        part.section->size = part.size;
+        offset = alignSection(offset + part.size);
+    }
+    header.fileSize = offset;
+
+    auto tempPath = cachePath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        const char zeros[64] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(MeshCacheHeader));
+
+        uint64_t written = sizeof(MeshCacheHeader);
+        for (const auto& part : parts)
+        {
+            file.write(zeros, std::streamsize(part.section->offset - written));
+            file.write(static_cast<const char*>(part.data), std::streamsize(part.size));
+            written = part.section->offset + part.size;
+        }
+        file.write(zeros, std::streamsize(header.fileSize - written));
+
+        if (!file.flush())
+        {
+            std::cerr << "ERROR: Could not write mesh cache file '" << tempPath << "'.\n";
+            return false;
+        }
+    }
+
+    if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        std::cerr << "ERROR: Could not replace mesh cache file '" << cachePath << "'.\n";
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+inline shared_ptr<TriangleMesh> loadCachedMesh(const std::string& path, const std::function<shared_ptr<Material>(const MeshMaterialSlot&)>& materialFor,
+                                               const BvhBuildOptions& options = TriangleMesh::defaultBuildOptions())
+{
+    // Loads the mesh file at path through its cache file (path + ".rtcache"). A valid cache is
+    // mapped and used in place; otherwise the mesh file is loaded, its BVH built, and the cache
+    // written for the next run. materialFor() picks the material of every material slot. Returns
+    // nullptr if the mesh file cannot be loaded.
+
+    Timer loadTimer;
+    auto cachePath = path + ".rtcache";
+
+    auto slotMaterials = [&](std::vector<MeshMaterialSlot> slots) {
+        if (slots.empty())
+            slots.push_back(MeshMaterialSlot());
+
+        std::vector<shared_ptr<Material>> materials;
+        for (const auto& slot : slots)
+            materials.push_back(materialFor(slot));
+        return materials;
+    };
+
+    MeshCacheHeader expected;
+    expected.setOptions(options);
+    bool stamped = mesh_cache_detail::sourceStamp(path, expected);
+
+    auto cache = make_shared<MeshCache>();
+    if (stamped && cache->open(cachePath, expected))
+    {
+        auto mesh = make_shared<TriangleMesh>(cache, cache->view(), cache->tree(), slotMaterials(cache->materialSlots()));
+        std::clog << "Mesh '" << path << "' mapped from cache, " << mesh->meshView().triangleCount << " triangles in " << loadTimer.seconds() << " s\n";
+        return mesh;
+    }
+
+    auto data = make_shared<MeshData>();
+    if (!loadMesh(path, *data))
+        return nullptr;
+
+    auto mesh = make_shared<TriangleMesh>(data, slotMaterials(data->materialSlots), options);
+    std::clog << "Mesh '" << path << "' loaded, " << data->triangleCount() << " triangles in " << loadTimer.seconds() << " s\n";
+
+    if (stamped)
+        saveMeshCache(cachePath, expected, *mesh, data->materialSlots, data->materialLibraries);
+    return mesh;
+}
+
+inline shared_ptr<TriangleMesh> loadCachedMesh(const std::string& path, shared_ptr<Material> mat,
+                                               const BvhBuildOptions& options = TriangleMesh::defaultBuildOptions())
+{
+    return loadCachedMesh(path, [&](const MeshMaterialSlot&) { return mat; }, options);
+}
+
+#endif//_MESH_CACHE_H_
@@ -0,0 +1,591 @@
+#ifndef _MESH_LOADER_H_
+#define _MESH_LOADER_H_
+
+#include "triangle_mesh.h"
+
+#include <algorithm> // std::min(), std::reverse()
+#include <cctype>    // std::tolower()
+#include <cstdint>
+#include <cstdlib> // std::strtof(), std::strtol()
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Mesh file loaders. Both read the file front to back in one pass without holding its text or
+// bytes in memory, and append straight into the flat MeshData arrays. Polygons with more than
+// three corners are split into triangle fans. On failure they print an error, leave the mesh
+// empty and return false.
+
+namespace mesh_loader_detail
+{
+inline bool fail(MeshData& mesh, const std::string& path, const std::string& message)
+{
+    std::cerr << "ERROR: Could not load mesh file '" << path << "': " << message << ".\n";
+    mesh = MeshData();
+    return false;
+}
+
+inline bool hasExtension(const std::string& path, const char* extension)
+{
+    auto length = std::strlen(extension);
+    if (path.size() < length)
+        return false;
+
+    for (size_t i = 0; i < length; i++)
+        if (std::tolower(path[path.size() - length + i]) != extension[i])
+            return false;
+    return true;
+}
+
+inline const char* skipSpaces(const char* p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+struct ObjCorner
+{
+    // One face corner of an OBJ file: 0-based position, texture coordinate and normal
+    // indices, -1 where the corner has none.
+    long position = -1, uv = -1, normal = -1;
+
+    bool operator==(const ObjCorner& other) const { return position == other.position && uv == other.uv && normal == other.normal; }
+};
+
+struct ObjCornerHash
+{
+    size_t operator()(const ObjCorner& c) const { return std::hash<long>()(c.position * 73856093L ^ c.uv * 19349663L ^ c.normal * 83492791L); }
+};
+
+class BufferedReader
+{
+    // Reads binary data through a fixed buffer, so that many small reads don't each go
+    // through the stream.
+
+public:
+    BufferedReader(std::ifstream& in) : in(in), buffer(1 << 20) {}
+
+    bool read(void* destination, size_t size)
+    {
+        auto out = static_cast<char*>(destination);
+        while (size > 0)
+        {
+            if (position == end && !refill())
+                return false;
+
+            auto count = std::min(size, end - position);
+            std::memcpy(out, buffer.data() + position, count);
+            position += count;
+            out += count;
+            size -= count;
+        }
+        return true;
+    }
+
+private:
+    std::ifstream& in;
+    std::vector<char> buffer;
+    size_t position = 0;
+    size_t end = 0;
+
+    bool refill()
+    {
+        in.read(buffer.data(), std::streamsize(buffer.size()));
+        end = size_t(in.gcount());
+        position = 0;
+        return end > 0;
+    }
+};
+
+inline std::string directoryOf(const std::string& path)
+{
+    auto slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+inline std::string restOfLine(const char* p)
+{
+    // The statement argument with surrounding white space removed.
+    std::string rest(skipSpaces(p));
+    while (!rest.empty() && std::isspace((unsigned char)rest.back()))
+        rest.pop_back();
+    return rest;
+}
+
+inline void readMtlTextures(const std::string& path, std::vector<MeshMaterialSlot>& slots)
+{
+    // Sets the texture of every slot to the map_Kd file its newmtl block names in the MTL
+    // library at path. Texture paths are made relative to the working directory like the
+    // library path itself. Map options (-bm, -s, ...) are skipped: the file name is the last word.
+
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "WARNING: Could not open material library '" << path << "'.\n";
+        return;
+    }
+
+    std::string line;
+    MeshMaterialSlot* current = nullptr;
+    while (std::getline(in, line))
+    {
+        const char* p = skipSpaces(line.c_str());
+        if (std::strncmp(p, "newmtl", 6) == 0 && std::isspace((unsigned char)p[6]))
+        {
+            auto name = restOfLine(p + 6);
+            current = nullptr;
+            for (auto& slot : slots)
+                if (slot.name == name)
+                    current = &slot;
+        }
+        else if (current != nullptr && std::strncmp(p, "map_Kd", 6) == 0 && std::isspace((unsigned char)p[6]))
+        {
+            auto arguments = restOfLine(p + 6);
+            auto space = arguments.find_last_of(" \t");
+            current->texture = directoryOf(path) + (space == std::string::npos ? arguments : arguments.substr(space + 1));
+        }
+    }
+}
+} // namespace mesh_loader_detail
+
+inline bool loadObj(const std::string& path, MeshData& mesh)
+{
+    // Reads the v, vt, vn, f, usemtl and mtllib statements of a Wavefront OBJ file and ignores
+    // the rest. Every usemtl name becomes a material slot, and the diffuse texture maps of the
+    // mtllib libraries become the slots' texture references.
+    // OBJ indexes positions, texture coordinates and normals separately, while MeshData has one
+    // index per vertex, so each distinct combination used by a face corner becomes one vertex.
+    // Corners with a position only, the common case for large scanned meshes, skip the hash
+    // map and are looked up by position index.
+
+    using namespace mesh_loader_detail;
+
+    mesh = MeshData();
+    std::ifstream in(path);
+    if (!in)
+        return fail(mesh, path, "cannot open file");
+
+    std::vector<float> filePositions, fileUvs, fileNormals;
+    std::vector<uint32_t> positionOnlyVertex;
+    std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> cornerVertex;
+    std::vector<uint32_t> face;
+    uint16_t currentSlot = 0;
+    std::string line;
+    long lineNumber = 0;
+
+    auto readFloats = [](const char* p, float* values, int count) {
+        for (int i = 0; i < count; i++)
+        {
+            char* end;
+            values[i] = std::strtof(p, &end);
+            if (end == p)
+                return false;
+            p = end;
+        }
+        return true;
+    };
+
+    // OBJ indices are 1-based, negative ones count back from the last element read so far.
+    auto resolveIndex = [](long index, size_t count) { return index < 0 ? long(count) + index : index - 1; };
+
+    auto vertexFor = [&](const ObjCorner& corner) -> uint32_t {
+        if (corner.uv < 0 && corner.normal < 0)
+        {
+            if (positionOnlyVertex.size() <= size_t(corner.position))
+                positionOnlyVertex.resize(filePositions.size() / 3, UINT32_MAX);
+            auto& vertex = positionOnlyVertex[corner.position];
+            if (vertex != UINT32_MAX)
+                return vertex;
+            vertex = uint32_t(mesh.vertexCount());
+        }
+        else
+        {
+            auto found = cornerVertex.find(corner);
+            if (found != cornerVertex.end())
+                return found->second;
+            cornerVertex.emplace(corner, uint32_t(mesh.vertexCount()));
+        }
+
+        auto index = uint32_t(mesh.vertexCount());
+        mesh.positions.insert(mesh.positions.end(), &filePositions[3 * corner.position], &filePositions[3 * corner.position] + 3);
+        if (corner.uv >= 0)
+            mesh.uvs.insert(mesh.uvs.end(), &fileUvs[2 * corner.uv], &fileUvs[2 * corner.uv] + 2);
+        else
+            mesh.uvs.insert(mesh.uvs.end(), {0.0f, 0.0f});
+        if (corner.normal >= 0)
+            mesh.normals.insert(mesh.normals.end(), &fileNormals[3 * corner.normal], &fileNormals[3 * corner.normal] + 3);
+        else
+            mesh.normals.insert(mesh.normals.end(), {0.0f, 0.0f, 0.0f});
+        return index;
+    };
+
+    while (std::getline(in, line))
+    {
+        lineNumber++;
+        const char* p = skipSpaces(line.c_str());
+        float values[3];
+
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            if (!readFloats(p + 2, values, 3))
+                return fail(mesh, path, "bad vertex on line " + std::to_string(lineNumber));
+            filePositions.insert(filePositions.end(), values, values + 3);
+        }
+        else if (p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            if (!readFloats(p + 3, values, 2))
+                return fail(mesh, path, "bad texture coordinate on line " + std::to_string(lineNumber));
+            fileUvs.insert(fileUvs.end(), values, values + 2);
+        }
+        else if (p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            if (!readFloats(p + 3, values, 3))
+                return fail(mesh, path, "bad normal on line " + std::to_string(lineNumber));
+            fileNormals.insert(fileNormals.end(), values, values + 3);
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            // Corners are "v", "v/vt", "v//vn" or "v/vt/vn".
+            face.clear();
+            p = skipSpaces(p + 2);
+            while (*p != '\0' && *p != '\r')
+            {
+                char* end;
+                ObjCorner corner;
+                corner.position = resolveIndex(std::strtol(p, &end, 10), filePositions.size() / 3);
+                if (end == p)
+                    return fail(mesh, path, "bad face on line " + std::to_string(lineNumber));
+                p = end;
+
+                if (*p == '/')
+                {
+                    p++;
+                    if (*p != '/')
+                    {
+                        corner.uv = resolveIndex(std::strtol(p, &end, 10), fileUvs.size() / 2);
+                        p = end;
+                    }
+                    if (*p == '/')
+                    {
+                        corner.normal = resolveIndex(std::strtol(p + 1, &end, 10), fileNormals.size() / 3);
+                        p = end;
+                    }
+                }
+
+                if (corner.position < 0 || size_t(corner.position) >= filePositions.size() / 3
+                    || size_t(corner.uv + 1) > fileUvs.size() / 2 || size_t(corner.normal + 1) > fileNormals.size() / 3)
+                    return fail(mesh, path, "face index out of range on line " + std::to_string(lineNumber));
+
+                face.push_back(vertexFor(corner));
+                p = skipSpaces(p);
+            }
+
+            for (size_t i = 2; i < face.size(); i++)
+            {
+                mesh.indices.insert(mesh.indices.end(), {face[0], face[i - 1], face[i]});
+                mesh.triangleSlots.push_back(currentSlot);
+            }
+        }
+        else if (std::strncmp(p, "usemtl", 6) == 0 && std::isspace((unsigned char)p[6]))
+        {
+            // Faces before the first usemtl keep an unnamed slot 0.
+            if (mesh.materialSlots.empty() && !mesh.indices.empty())
+                mesh.materialSlots.push_back(MeshMaterialSlot());
+
+            auto name = restOfLine(p + 6);
+            size_t slot = 0;
+            while (slot < mesh.materialSlots.size() && mesh.materialSlots[slot].name != name)
+                slot++;
+            if (slot == mesh.materialSlots.size())
+            {
+                if (slot > UINT16_MAX)
+                    return fail(mesh, path, "too many materials");
+                mesh.materialSlots.push_back({name, ""});
+            }
+            currentSlot = uint16_t(slot);
+        }
+        else if (std::strncmp(p, "mtllib", 6) == 0 && std::isspace((unsigned char)p[6]))
+        {
+            mesh.materialLibraries.push_back(directoryOf(path) + restOfLine(p + 6));
+        }
+    }
+
+    for (const auto& library : mesh.materialLibraries)
+        readMtlTextures(library, mesh.materialSlots);
+
+    // A single slot needs no per-triangle slot array.
+    if (mesh.materialSlots.size() <= 1)
+        mesh.triangleSlots.clear();
+
+    // Attributes no face corner provided are dropped rather than kept as zeros.
+    if (fileUvs.empty())
+        mesh.uvs.clear();
+    if (fileNormals.empty())
+        mesh.normals.clear();
+
+    if (mesh.indices.empty())
+        return fail(mesh, path, "no faces");
+    return true;
+}
+
+inline bool loadPly(const std::string& path, MeshData& mesh)
+{
+    // Reads a binary (little or big endian) PLY file. The vertex element's x/y/z, nx/ny/nz and
+    // u/v (or s/t) properties and the face element's vertex index list are kept; other elements
+    // and properties are read past.
+
+    using namespace mesh_loader_detail;
+
+    mesh = MeshData();
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return fail(mesh, path, "cannot open file");
+
+    enum class Type { Int8, Uint8, Int16, Uint16, Int32, Uint32, Float32, Float64, Invalid };
+
+    struct Property
+    {
+        std::string name;
+        Type type = Type::Invalid;
+        Type countType = Type::Invalid; // List properties only
+        bool isList = false;
+    };
+
+    struct Element
+    {
+        std::string name;
+        size_t count = 0;
+        std::vector<Property> properties;
+    };
+
+    auto parseType = [](const std::string& name) {
+        if (name == "char" || name == "int8") return Type::Int8;
+        if (name == "uchar" || name == "uint8") return Type::Uint8;
+        if (name == "short" || name == "int16") return Type::Int16;
+        if (name == "ushort" || name == "uint16") return Type::Uint16;
+        if (name == "int" || name == "int32") return Type::Int32;
+        if (name == "uint" || name == "uint32") return Type::Uint32;
+        if (name == "float" || name == "float32") return Type::Float32;
+        if (name == "double" || name == "float64") return Type::Float64;
+        return Type::Invalid;
+    };
+
+    auto typeSize = [](Type type) -> size_t {
+        switch (type)
+        {
+            case Type::Int8: case Type::Uint8: return 1;
+            case Type::Int16: case Type::Uint16: return 2;
+            case Type::Int32: case Type::Uint32: case Type::Float32: return 4;
+            case Type::Float64: return 8;
+            default: return 0;
+        }
+    };
+
+    // Header
+    std::string line;
+    if (!std::getline(in, line) || line.compare(0, 3, "ply") != 0)
+        return fail(mesh, path, "not a PLY file");
+
+    bool bigEndian = false;
+    std::vector<Element> elements;
+    while (true)
+    {
+        if (!std::getline(in, line))
+            return fail(mesh, path, "truncated header");
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        std::istringstream words(line);
+        std::string keyword;
+        words >> keyword;
+
+        if (keyword == "end_header")
+            break;
+
+        if (keyword == "format")
+        {
+            std::string format;
+            words >> format;
+            if (format == "binary_big_endian")
+                bigEndian = true;
+            else if (format != "binary_little_endian")
+                return fail(mesh, path, "format '" + format + "' is not supported, only binary PLY files are");
+        }
+        else if (keyword == "element")
+        {
+            Element element;
+            words >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if (keyword == "property")
+        {
+            if (elements.empty())
+                return fail(mesh, path, "property outside of an element");
+
+            Property property;
+            std::string type;
+            words >> type;
+            if (type == "list")
+            {
+                std::string countType, itemType;
+                words >> countType >> itemType;
+                property.isList = true;
+                property.countType = parseType(countType);
+                property.type = parseType(itemType);
+                if (property.countType == Type::Invalid)
+                    return fail(mesh, path, "unknown property type '" + countType + "'");
+            }
+            else
+            {
+                property.type = parseType(type);
+            }
+            if (property.type == Type::Invalid)
+                return fail(mesh, path, "unknown property type in '" + line + "'");
+
+            words >> property.name;
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    // Body
+    BufferedReader reader(in);
+    bool hostBigEndian = false;
+    {
+        uint16_t probe = 1;
+        unsigned char firstByte;
+        std::memcpy(&firstByte, &probe, 1);
+        hostBigEndian = firstByte == 0;
+    }
+
+    auto readValue = [&](Type type, double& value) {
+        unsigned char bytes[8];
+        auto size = typeSize(type);
+        if (!reader.read(bytes, size))
+            return false;
+        if (bigEndian != hostBigEndian)
+            std::reverse(bytes, bytes + size);
+
+        switch (type)
+        {
+            case Type::Int8: { int8_t v; std::memcpy(&v, bytes, 1); value = v; break; }
+            case Type::Uint8: { uint8_t v; std::memcpy(&v, bytes, 1); value = v; break; }
+            case Type::Int16: { int16_t v; std::memcpy(&v, bytes, 2); value = v; break; }
+            case Type::Uint16: { uint16_t v; std::memcpy(&v, bytes, 2); value = v; break; }
+            case Type::Int32: { int32_t v; std::memcpy(&v, bytes, 4); value = v; break; }
+            case Type::Uint32: { uint32_t v; std::memcpy(&v, bytes, 4); value = v; break; }
+            case Type::Float32: { float v; std::memcpy(&v, bytes, 4); value = v; break; }
+            case Type::Float64: { double v; std::memcpy(&v, bytes, 8); value = v; break; }
+            default: return false;
+        }
+        return true;
+    };
+
+    std::vector<uint32_t> face;
+    for (const auto& element : elements)
+    {
+        bool isVertex = element.name == "vertex";
+        bool isFace = element.name == "face";
+
+        // Where each vertex property goes: 0-2 position, 3-5 normal, 6-7 uv, -1 nowhere.
+        std::vector<int> slot(element.properties.size(), -1);
+        bool hasNormals = false, hasUvs = false;
+        if (isVertex)
+        {
+            const char* names[] = {"x", "y", "z", "nx", "ny", "nz", "u", "v", "s", "t", "texture_u", "texture_v"};
+            const int slots[] = {0, 1, 2, 3, 4, 5, 6, 7, 6, 7, 6, 7};
+            for (size_t p = 0; p < element.properties.size(); p++)
+                for (int n = 0; n < 12; n++)
+                    if (!element.properties[p].isList && element.properties[p].name == names[n])
+                        slot[p] = slots[n];
+
+            for (auto s : slot)
+            {
+                hasNormals = hasNormals || (s >= 3 && s <= 5);
+                hasUvs = hasUvs || s >= 6;
+            }
+
+            mesh.positions.reserve(3 * element.count);
+            if (hasNormals)
+                mesh.normals.reserve(3 * element.count);
+            if (hasUvs)
+                mesh.uvs.reserve(2 * element.count);
+        }
+        else if (isFace)
+        {
+            mesh.indices.reserve(3 * element.count);
+        }
+
+        for (size_t i = 0; i < element.count; i++)
+        {
+            double vertex[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+            for (size_t p = 0; p < element.properties.size(); p++)
+            {
+                const auto& property = element.properties[p];
+                double value;
+
+                if (!property.isList)
+                {
+                    if (!readValue(property.type, value))
+                        return fail(mesh, path, "unexpected end of file");
+                    if (slot[p] >= 0)
+                        vertex[slot[p]] = value;
+                    continue;
+                }
+
+                double count;
+                if (!readValue(property.countType, count))
+                    return fail(mesh, path, "unexpected end of file");
+
+                bool isIndexList = isFace && (property.name == "vertex_indices" || property.name == "vertex_index");
+                face.clear();
+                for (long k = 0; k < long(count); k++)
+                {
+                    if (!readValue(property.type, value))
+                        return fail(mesh, path, "unexpected end of file");
+                    if (isIndexList)
+                        face.push_back(uint32_t(value));
+                }
+
+                if (isIndexList)
+                {
+                    for (auto index : face)
+                        if (index >= mesh.vertexCount())
+                            return fail(mesh, path, "face index out of range");
+                    for (size_t k = 2; k < face.size(); k++)
+                        mesh.indices.insert(mesh.indices.end(), {face[0], face[k - 1], face[k]});
+                }
+            }
+
+            if (isVertex)
+            {
+                mesh.positions.insert(mesh.positions.end(), {float(vertex[0]), float(vertex[1]), float(vertex[2])});
+                if (hasNormals)
+                    mesh.normals.insert(mesh.normals.end(), {float(vertex[3]), float(vertex[4]), float(vertex[5])});
+                if (hasUvs)
+                    mesh.uvs.insert(mesh.uvs.end(), {float(vertex[6]), float(vertex[7])});
+            }
+        }
+    }
+
+    if (mesh.indices.empty())
+        return fail(mesh, path, "no faces");
+    return true;
+}
+
+inline bool loadMesh(const std::string& path, MeshData& mesh)
+{
+    // Picks the loader by file extension.
+
+    if (mesh_loader_detail::hasExtension(path, ".obj"))
+        return loadObj(path, mesh);
+    if (mesh_loader_detail::hasExtension(path, ".ply"))
+        return loadPly(path, mesh);
+    return mesh_loader_detail::fail(mesh, path, "unknown mesh file extension");
+}
+
+#endif//_MESH_LOADER_H_
@@ -0,0 +1,98 @@
+#ifndef _MIPMAP_H_
+#define _MIPMAP_H_
+
+#include "texture_cache.h"
+
+#include <algorithm> // std::min(), std::max()
+#include <cmath>
+#include <string>
+#include <vector>
+
+enum class TextureFilter
+{
+    Nearest,   // The level 0 texel the coordinates fall in
+    Bilinear,  // Blend of the four nearest level 0 texels
+    Trilinear  // Bilinear lookups in the two levels matching the footprint, blended
+};
+
+class MipMap
+{
+    // Filtered lookups into the MIP pyramid of an image in the texture cache (texture_cache.h).
+    // Level 0 is the image itself; every further level is half the size of the one before,
+    // each texel the average of the 2x2 texels below it, down to a single texel. A lookup whose
+    // footprint covers many texels reads a coarser level instead of a scattering of full
+    // resolution texels: less aliasing noise per sample, and far fewer pages touched on big
+    // images.
+    //
+    // Texture coordinates s, t run over [0,1] from the left and the top; both are clamped.
+
+public:
+    MipMap() {}
+
+    // Opens the image at path in the cache; nothing is decoded until the first lookup.
+    explicit MipMap(const std::string& path) : image(textureCache().open(path))
+    {
+        if (image != TextureCache::invalidImage)
+            sizes = textureCache().levels(image);
+    }
+
+    int levels() const { return int(sizes.size()); }
+    int width(int level = 0) const { return sizes[level].width; }
+    int height(int level = 0) const { return sizes[level].height; }
+
+    Color lookup(double s, double t, const glm::dvec2& footprint, TextureFilter filter) const
+    {
+        // footprint is the width in texture coordinates of the area the lookup stands for, per
+        // axis; only trilinear filtering uses it. The level is picked by the larger axis, which
+        // blurs stretched footprints a little rather than alias along their long side.
+        s = Interval(0, 1).clamp(s);
+        t = Interval(0, 1).clamp(t);
+
+        if (filter == TextureFilter::Nearest)
+            return nearest(s, t);
+        if (filter == TextureFilter::Bilinear)
+            return bilinear(0, s, t);
+
+        auto texels = std::max(footprint.x * width(), footprint.y * height());
+        if (texels <= 1)
+            return bilinear(0, s, t);
+
+        auto lod = std::log2(texels);
+        if (lod >= levels() - 1)
+            return bilinear(levels() - 1, s, t);
+
+        int level = int(lod);
+        auto blend = lod - level;
+        return (1 - blend) * bilinear(level, s, t) + blend * bilinear(level + 1, s, t);
+    }
+
+private:
+    TextureCache::ImageId image = TextureCache::invalidImage;
+    std::vector<TextureCache::LevelSize> sizes;
+
+    Color texel(int level, int x, int y) const
+    {
+        x = std::min(std::max(x, 0), width(level) - 1);
+        y = std::min(std::max(y, 0), height(level) - 1);
+        return textureCache().texel(image, level, x, y);
+    }
+
+    Color nearest(double s, double t) const { return texel(0, int(s * width()), int(t * height())); }
+
+    Color bilinear(int level, double s, double t) const
+    {
+        // Texel centers sit at half-integer coordinates.
+        auto x = s * width(level) - 0.5;
+        auto y = t * height(level) - 0.5;
+        auto x0 = std::floor(x);
+        auto y0 = std::floor(y);
+        auto fx = x - x0;
+        auto fy = y - y0;
+        int i = int(x0), j = int(y0);
+
+        return (1 - fy) * ((1 - fx) * texel(level, i, j) + fx * texel(level, i + 1, j)) +
+               fy * ((1 - fx) * texel(level, i, j + 1) + fx * texel(level, i + 1, j + 1));
+    }
+};
+
+#endif//_MIPMAP_H_
@@ -7,12 +7,13 @@
 class Quad : public Hittable
 {
 public:
-    Quad(const Point& Q, const glm::dvec3& u, const glm::dvec3& v, shared_ptr<Material> mat) : Q(Q), u(u), v(v), mat(mat)
+    Quad(const Point& Q, const glm::dvec3& u, const glm::dvec3& v, shared_ptr<Material> mat) : Q(Q), u(u), v(v), mat(materialTable().add(mat))
     {
         auto n = glm::cross(u, v);
         normal = glm::normalize(n);
         D = glm::dot(normal, Q);
         w = n / glm::dot(n, n);
+        area = glm::length(n);
 
         setBoundingBox();
     }
@@ -46,15 +47,50 @@ public:
 
         if (!isInterior(alpha, beta, rec)) return false;
 
-        // Ray hits the 2D shape; set the rest of the hit record and return true.
+        // Ray hits the 2D shape; the rest of the hit record is set by finalizeHit().
         rec.t = t;
-        rec.p = intersection;
-        rec.mat = mat;
-        rec.setFaceNormal(r, normal);
+        rec.object = this;
 
         return true;
     }
 
+    bool occluded(const Ray& r, Interval rayT) const override
+    {
+        // hit() only writes t and the plane coordinates, so it is as cheap as a separate test.
+        HitRecord rec;
+        return hit(r, rayT, rec);
+    }
+
+    double pdfValue(const Point& origin, const glm::dvec3& direction) const override
+    {
+        // Points are sampled uniformly over the parallelogram Q, u, v. For shapes inside it,
+        // like Triangle, samples that land outside the shape just miss it; shapes reaching past
+        // it (the primitives.h curves) cannot be sampled this way.
+        HitRecord rec;
+        if (!hit(Ray(origin, direction), Interval(0.001, INF), rec))
+            return 0;
+
+        auto distanceSquared = rec.t * rec.t * glm::dot(direction, direction);
+        auto cosine = std::fabs(glm::dot(direction, normal) / glm::length(direction));
+
+        return distanceSquared / (cosine * area);
+    }
+
+    glm::dvec3 random(const Point& origin) const override
+    {
+        auto p = Q + (randomDoubleGen() * u) + (randomDoubleGen() * v);
+        return p - origin;
+    }
+
+    void finalizeHit(const Ray& r, HitRecord& rec) const override
+    {
+        rec.p = r.at(rec.t);
+        rec.mat = mat;
+        rec.setFaceNormal(r, normal);
+        rec.dpdu = u;
+        rec.dpdv = v;
+    }
+
     virtual bool isInterior(double a, double b, HitRecord& rec) const
     {
         Interval unitInterval = Interval(0, 1);
@@ -73,10 +109,11 @@ private:
     Point Q;
     glm::dvec3 u, v;
     glm::dvec3 w;
-    shared_ptr<Material> mat;
+    MaterialId mat;
     Aabb bbox;
     glm::dvec3 normal;
     double D;
+    double area;
 };
 
 inline shared_ptr<HittableList> box(const Point& a, const Point& b, shared_ptr<Material> mat)
@@ -3,19 +3,44 @@
 
 class Ray
 {
+    // Besides origin and direction, a ray carries the reciprocal of its direction and the sign of
+    // each direction component, which every box test along its traversal needs. A zero component
+    // gives an infinite reciprocal; the slab tests are written to cope with that.
+
 public:
     Ray() {}
-    Ray(const Point& origin, const glm::dvec3& direction, double time) : orig(origin), dir(direction), tm(time) {}
+    Ray(const Point& origin, const glm::dvec3& direction, double time) : orig(origin), dir(direction), tm(time) { updateInverse(); }
     Ray(const Point& origin, const glm::dvec3& direction) : Ray(origin, direction, 0) {}
+
+    // The ray moved to a new origin, with the direction data copied rather than recomputed.
+    Ray(const Ray& r, const Point& origin) : orig(origin), dir(r.dir), invDir(r.invDir), tm(r.tm)
+    {
+        negative[0] = r.negative[0];
+        negative[1] = r.negative[1];
+        negative[2] = r.negative[2];
+    }
+
     const Point& origin() const { return orig; }
     const glm::dvec3& direction() const { return dir; }
+    const glm::dvec3& invDirection() const { return invDir; }
+    bool dirIsNegative(int axis) const { return negative[axis]; }
     double time() const { return tm; }
     Point at(double t) const { return orig + t * dir; }
 
 private:
     Point orig;
     glm::dvec3 dir;
-    double tm;
+    glm::dvec3 invDir;
+    bool negative[3] = {false, false, false};
+    double tm = 0;
+
+    void updateInverse()
+    {
+        invDir = glm::dvec3(1.0 / dir.x, 1.0 / dir.y, 1.0 / dir.z);
+        negative[0] = std::signbit(dir.x);
+        negative[1] = std::signbit(dir.y);
+        negative[2] = std::signbit(dir.z);
+    }
 };
 
 #endif//_RAY_H_
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef _RESOURCE_TABLE_H_
+#define _RESOURCE_TABLE_H_
+
+#include "common.h"
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class Material;
+class Texture;
+
+// Materials and textures are authored as before, as shared_ptrs to the Material and Texture
+// classes, but primitives, hit records and materials refer to them by index into a table that
+// owns them. A hit record then carries a plain integer instead of a shared_ptr, so finding and
+// copying hits in the traversal loops does no reference counting.
+using MaterialId = uint32_t;
+using TextureId = uint32_t;
+
+template <typename T>
+class ResourceTable
+{
+    // Owns the resources of the scene and hands out their IDs. Adding the same object twice
+    // returns the same ID. Everything is added while the scene is built; lookups during
+    // rendering take no lock, so nothing may be added once rendering has started.
+
+public:
+    uint32_t add(const shared_ptr<T>& resource)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        auto found = ids.find(resource.get());
+        if (found != ids.end())
+            return found->second;
+
+        auto id = uint32_t(entries.size());
+        entries.push_back(resource);
+        ids.emplace(resource.get(), id);
+        return id;
+    }
+
+    const T& operator[](uint32_t id) const { return *entries[id]; }
+
+    size_t size() const { return entries.size(); }
+
+private:
+    std::mutex lock;
+    std::vector<shared_ptr<T>> entries;
+    std::unordered_map<const T*, uint32_t> ids;
+};
+
+inline ResourceTable<Material>& materialTable()
+{
+    static ResourceTable<Material> table;
+    return table;
+}
+
+inline ResourceTable<Texture>& textureTable()
+{
+    static ResourceTable<Texture> table;
+    return table;
+}
+
+#endif//_RESOURCE_TABLE_H_
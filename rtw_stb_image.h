@@ -10,8 +10,12 @@
 #define STBI_FAILURE_USERMSG
 
 #include <stb/stb_image.h>
+#include <array>
+#include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 
 class RtwImage
 {
@@ -20,86 +24,106 @@ public:
 
     RtwImage(const char* image_filename)
     {
-        // Loads image data from the specified file. If the RTW_IMAGES environment variable is
-        // defined, looks only in that directory for the image file. If the image was not found,
+        // Loads image data from the specified file, found with locate(). If the image was not
+        // loaded successfully, width() and height() will return 0.
+
+        auto path = locate(image_filename);
+        if (path.empty() || !load(path))
+            std::cerr << "ERROR: Could not load image file '" << image_filename << "'.\n";
+    }
+
+    static std::string locate(const char* image_filename)
+    {
+        // Returns the path of the image file, or an empty string if there is none. If the
+        // RTW_IMAGES environment variable is defined, looks first in that directory. Otherwise
         // searches for the specified image file first from the current directory, then in the
         // images/ subdirectory, then the _parent's_ images/ subdirectory, and then _that_
-        // parent, on so on, for six levels up. If the image was not loaded successfully,
-        // width() and height() will return 0.
+        // parent, on so on, for six levels up. Candidates are tested by reading their header
+        // only.
 
         auto filename = std::string(image_filename);
         auto imagedir = getenv("RTW_IMAGES");
 
-        // Hunt for the image file in some likely locations.
-        if (imagedir && load(std::string(imagedir) + "/" + image_filename))
-            return;
-        if (load(filename))
-            return;
-        if (load("images/" + filename))
-            return;
-        if (load("../images/" + filename))
-            return;
-        if (load("../../images/" + filename))
-            return;
-        if (load("../../../images/" + filename))
-            return;
-        if (load("../../../../images/" + filename))
-            return;
-        if (load("../../../../../images/" + filename))
-            return;
-        if (load("../../../../../../images/" + filename))
-            return;
-
-        std::cerr << "ERROR: Could not load image file '" << image_filename << "'.\n";
-    }
-
-    ~RtwImage()
-    {
-        delete[] bdata;
-        STBI_FREE(fdata);
+        std::vector<std::string> candidates;
+        if (imagedir)
+            candidates.push_back(std::string(imagedir) + "/" + filename);
+        candidates.push_back(filename);
+        std::string parent;
+        for (int level = 0; level <= 6; level++, parent += "../")
+            candidates.push_back(parent + "images/" + filename);
+
+        for (const auto& candidate : candidates)
+        {
+            int x, y, n;
+            if (stbi_info(candidate.c_str(), &x, &y, &n))
+                return candidate;
+        }
+        return std::string();
     }
 
     bool load(const std::string& filename)
     {
-        // Loads the linear (gamma=1) image data from the given file name. Returns true if the
-        // load succeeded. The resulting data buffer contains the three [0.0, 1.0]
-        // floating-point values for the first pixel (red, then green, then blue). Pixels are
-        // contiguous, going left to right for the width of the image, followed by the next row
-        // below, for the full height of the image.
+        // Loads the linear (gamma=1) image data from the given file name as bytes. Returns true
+        // if the load succeeded. The resulting data buffer contains the three [0, 255] values
+        // for the first pixel (red, then green, then blue). Pixels are contiguous, going left
+        // to right for the width of the image, followed by the next row below, for the full
+        // height of the image.
+        //
+        // 8-bit files are decoded to bytes and linearized through a table of the gamma 2.2
+        // curve stb applies when it decodes them to floats, so no float copy of the image is
+        // ever made. Only HDR files take the float path.
 
         auto n = bytesPerPixel; // Dummy out parameter: original components per pixel
-        fdata = stbi_loadf(filename.c_str(), &imageWidth, &imageHeight, &n, bytesPerPixel);
-        if (fdata == nullptr)
-            return false;
+        if (stbi_is_hdr(filename.c_str()))
+        {
+            float* fdata = stbi_loadf(filename.c_str(), &imageWidth, &imageHeight, &n, bytesPerPixel);
+            if (fdata == nullptr)
+                return false;
+
+            bdata.resize(size_t(imageWidth) * imageHeight * bytesPerPixel);
+            for (size_t i = 0; i < bdata.size(); i++)
+                bdata[i] = floatToByte(fdata[i]);
+            stbi_image_free(fdata);
+        }
+        else
+        {
+            unsigned char* data = stbi_load(filename.c_str(), &imageWidth, &imageHeight, &n, bytesPerPixel);
+            if (data == nullptr)
+                return false;
+
+            static const auto linear = linearizeTable();
+            bdata.assign(data, data + size_t(imageWidth) * imageHeight * bytesPerPixel);
+            for (auto& byte : bdata)
+                byte = linear[byte];
+            stbi_image_free(data);
+        }
 
         bytesPerScanline = imageWidth * bytesPerPixel;
-        convertToBytes();
         return true;
     }
 
-    int width() const { return (fdata == nullptr) ? 0 : imageWidth; }
-    int height() const { return (fdata == nullptr) ? 0 : imageHeight; }
+    int width() const { return bdata.empty() ? 0 : imageWidth; }
+    int height() const { return bdata.empty() ? 0 : imageHeight; }
 
     const unsigned char* pixel_data(int x, int y) const
     {
         // Return the address of the three RGB bytes of the pixel at x,y. If there is no image
         // data, returns magenta.
         static unsigned char magenta[] = {255, 0, 255};
-        if (bdata == nullptr)
+        if (bdata.empty())
             return magenta;
 
         x = clamp(x, 0, imageWidth);
         y = clamp(y, 0, imageHeight);
 
-        return bdata + y * bytesPerScanline + x * bytesPerPixel;
+        return bdata.data() + size_t(y) * bytesPerScanline + x * bytesPerPixel;
     }
 
 private:
-    const int bytesPerPixel = 3;
-    float* fdata = nullptr;         // Linear floating point pixel data
-    unsigned char* bdata = nullptr; // Linear 8-bit pixel data
-    int imageWidth = 0;            // Loaded image width
-    int imageHeight = 0;           // Loaded image height
+    static const int bytesPerPixel = 3;
+    std::vector<unsigned char> bdata; // Linear 8-bit pixel data
+    int imageWidth = 0;               // Loaded image width
+    int imageHeight = 0;              // Loaded image height
     int bytesPerScanline = 0;
 
     static int clamp(int x, int low, int high)
@@ -121,21 +145,13 @@ private:
         return static_cast<unsigned char>(256.0 * value);
     }
 
-    void convertToBytes()
+    static std::array<unsigned char, 256> linearizeTable()
     {
-        // Convert the linear floating point pixel data to bytes, storing the resulting byte
-        // data in the `bdata` member.
-
-        int total_bytes = imageWidth * imageHeight * bytesPerPixel;
-        bdata = new unsigned char[total_bytes];
-
-        // Iterate through all pixel components, converting from [0.0, 1.0] float values to
-        // unsigned [0, 255] byte values.
-
-        auto* bptr = bdata;
-        auto* fptr = fdata;
-        for (auto i = 0; i < total_bytes; i++, fptr++, bptr++)
-            *bptr = floatToByte(*fptr);
+        // The byte each gamma 2.2 encoded byte turns into through a float decode.
+        std::array<unsigned char, 256> table;
+        for (int i = 0; i < 256; i++)
+            table[i] = floatToByte(float(std::pow(i / 255.0f, 2.2f)));
+        return table;
     }
 };
 
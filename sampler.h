@@ -0,0 +1,71 @@
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+#include <cstdint>
+
+class Pcg32
+{
+    // PCG32 (XSH-RR variant) random number generator by Melissa O'Neill, https://www.pcg-random.org/
+    // 64 bits of state and an odd stream increment; each stream is an independent sequence.
+
+public:
+    Pcg32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+    Pcg32(uint64_t initState, uint64_t initSequence) { seed(initState, initSequence); }
+
+    void seed(uint64_t initState, uint64_t initSequence)
+    {
+        state = 0;
+        inc = (initSequence << 1) | 1;
+        nextUint();
+        state += initState;
+        nextUint();
+    }
+
+    uint32_t nextUint()
+    {
+        uint64_t oldState = state;
+        state = oldState * 6364136223846793005ULL + inc;
+
+        auto xorShifted = uint32_t(((oldState >> 18) ^ oldState) >> 27);
+        auto rotation = uint32_t(oldState >> 59);
+        return (xorShifted >> rotation) | (xorShifted << ((-rotation) & 31));
+    }
+
+    double nextDouble()
+    {
+        // Returns a random real in [0,1) built from 32 random bits.
+        return nextUint() * (1.0 / 4294967296.0);
+    }
+
+private:
+    uint64_t state;
+    uint64_t inc;
+};
+
+inline uint64_t mixBits(uint64_t v)
+{
+    // SplitMix64 finalizer: scrambles nearby integers into unrelated 64-bit values.
+    v ^= v >> 30;
+    v *= 0xbf58476d1ce4e5b9ULL;
+    v ^= v >> 27;
+    v *= 0x94d049bb133111ebULL;
+    v ^= v >> 31;
+    return v;
+}
+
+inline Pcg32& threadSampler()
+{
+    // Every thread draws from its own generator, so sampling needs no locking.
+    thread_local Pcg32 sampler;
+    return sampler;
+}
+
+inline void seedPixelSample(uint64_t seed, uint64_t pixelIndex, uint64_t sampleIndex)
+{
+    // Restarts the calling thread's generator on the sequence owned by one sample of one pixel.
+    // The sequence depends only on these three values, so a pixel comes out bit-identical
+    // whichever thread renders it and however the image is split up.
+    threadSampler().seed(mixBits(seed ^ mixBits(pixelIndex * 0x9e3779b97f4a7c15ULL + sampleIndex)), pixelIndex);
+}
+
+#endif//_SAMPLER_H_
@@ -0,0 +1,776 @@
+#ifndef _SCENE_FILE_H_
+#define _SCENE_FILE_H_
+
+#include "bvh.h"
+#include "camera.h"
+#include "constant_medium.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "linear_bvh.h"
+#include "material.h"
+#include "mesh_cache.h"
+#include "primitives.h"
+#include "quad.h"
+#include "sphere.h"
+#include "texture.h"
+#include "wide_bvh.h"
+
+#include <algorithm> // std::fill(), std::none_of()
+#include <cerrno>
+#include <cmath> // std::floor()
+#include <cstdlib> // std::strtod(), std::strtoull()
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Scene files describe the camera and the world in plain text, one statement per line. A line
+// starting with white space continues the statement of the line before, and '#' starts a comment.
+// Numbers may be written as fractions (16/9). Wherever a texture is expected, either the name of
+// a texture or an inline R G B color can be given. File paths are relative to the working
+// directory.
+//
+//   camera KEY VALUE...
+//       aspect N, width N, spp N, depth N, background R G B, sky (sky gradient instead of a
+//       background color), fov DEGREES, from X Y Z, at X Y Z, up X Y Z, defocus DEGREES,
+//       focus DISTANCE, threads N, tile N, seed N, adaptive (switch on adaptive sampling),
+//       threshold N, min_samples N, max_samples N, roulette N, sample_lights (switch on light
+//       sampling), denoise (switch on the denoiser), denoise_iterations N, feature_samples N,
+//       output PATH, aov PREFIX (also write PREFIX.depth.pfm, .normal, .albedo, .id, .samples and
+//       .variance), checkpoint PATH, checkpoint_interval SECONDS, resume
+//
+//   texture NAME solid R G B | checker SCALE TEXTURE TEXTURE | image PATH [nearest | bilinear | trilinear]
+//                | noise SCALE                  (PATH: an image file, or a .rtt file made by texconv)
+//   material NAME lambertian TEXTURE | metal R G B FUZZ | dielectric INDEX | light TEXTURE
+//                 | isotropic TEXTURE
+//
+//   Objects, added to the world or to the group being defined:
+//   sphere X Y Z RADIUS MATERIAL [to X Y Z]   (moving from the first to the second center)
+//   quad | triangle Q u v MATERIAL            (Q, u, v are three numbers each)
+//   circle Q u v MATERIAL RADIUS
+//   annulus Q u v MATERIAL INNER OUTER
+//   ellipse Q u v MATERIAL RADIUS_X RADIUS_Y
+//   parabola Q u v MATERIAL P VERTICAL(0|1)
+//   hyperbola Q u v MATERIAL C LENGTH
+//   box X0 Y0 Z0 X1 Y1 Z1 MATERIAL
+//   mesh PATH MATERIAL                         (OBJ or PLY, through the mesh cache)
+//   medium DENSITY TEXTURE OBJECT              (the object, e.g. a box, is only the boundary)
+//   use NAME                                   (a group defined earlier)
+//   instance NAME                              (a group placed through an Instance)
+//
+//   Any object may be followed by transforms, applied in the order written: translate X Y Z,
+//   rotate_x DEGREES, rotate_y DEGREES, rotate_z DEGREES, and for instances also scale S.
+//
+//   group NAME [list | bvh | linear | wide] [sah]  ... objects ...  end
+//       Collects the objects up to the matching end under NAME, behind the given acceleration
+//       structure (list by default). A group is only added to the scene through use or instance.
+//
+// Light sampling picks among the lights of the scene: the quads, triangles, boxes and stationary
+// spheres with a light material that are not inside a group, with their translations and
+// rotations. Other emitters still light the scene, but only when a scattered ray hits them.
+
+class SceneParser
+{
+public:
+    bool parse(const std::string& path, HittableList& world, HittableList& lights, Camera& cam)
+    {
+        // Reads the scene file at path into world, its lights and cam. On an error, prints the
+        // file, line and reason, and returns false.
+
+        scenePath = path;
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cerr << "ERROR: Could not open scene file '" << path << "'.\n";
+            return false;
+        }
+
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        text = contents.str();
+
+        camera = &cam;
+        cam.sceneHash = hashBytes(nullptr, 0);
+        cam.useBackground = true;
+        cam.background = Color(0, 0, 0);
+
+        groups.clear();
+        groupStack.clear();
+        groupStack.push_back({"", "list", false, HittableList()});
+        sceneLights.clear();
+
+        // Statements are cut out of the text and split into words in the same pass.
+        const char* p = text.c_str();
+        const char* end = p + text.size();
+        lineNumber = 0;
+        int nextLine = 1;
+
+        while (p < end)
+        {
+            words.clear();
+            lineNumber = nextLine;
+
+            do
+            {
+                // One physical line
+                while (p < end && *p != '\n')
+                {
+                    if (*p == ' ' || *p == '\t' || *p == '\r')
+                    {
+                        p++;
+                    }
+                    else if (*p == '#')
+                    {
+                        while (p < end && *p != '\n')
+                            p++;
+                    }
+                    else
+                    {
+                        const char* start = p;
+                        while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#')
+                            p++;
+                        words.emplace_back(start, size_t(p - start));
+                    }
+                }
+                if (p < end)
+                    p++;
+                nextLine++;
+            } while (p < end && (*p == ' ' || *p == '\t'));
+
+            if (words.empty())
+                continue;
+
+            next = 0;
+            unhashed.assign(words.size(), false);
+            if (!statement())
+            {
+                std::cerr << "ERROR: " << scenePath << ":" << lineNumber << ": " << error << ".\n";
+                return false;
+            }
+
+            // The scene hash covers what decides the samples, word by word, so comments, layout
+            // and the camera settings that do not touch the samples can change without
+            // orphaning a checkpoint.
+            for (size_t i = 0; i < words.size(); i++)
+                if (!unhashed[i])
+                    cam.sceneHash = hashBytes(words[i].data(), words[i].size(), hashBytes(" ", 1, cam.sceneHash));
+        }
+
+        if (groupStack.size() > 1)
+        {
+            std::cerr << "ERROR: " << scenePath << ": group '" << groupStack.back().name << "' has no end.\n";
+            return false;
+        }
+
+        world = groupStack.back().objects;
+        lights = sceneLights;
+        return true;
+    }
+
+private:
+    struct Group
+    {
+        std::string name;
+        std::string accelerator;
+        bool sah;
+        HittableList objects;
+    };
+
+    std::string scenePath;
+    std::string text;
+    std::vector<std::string_view> words;
+    std::vector<bool> unhashed; // Words of the statement left out of Camera::sceneHash
+    size_t next = 0;
+    int lineNumber = 0;
+    std::string error;
+
+    Camera* camera = nullptr;
+    std::unordered_map<std::string, shared_ptr<Texture>> textures;
+    std::unordered_map<std::string, shared_ptr<Material>> materials;
+    std::unordered_map<std::string, shared_ptr<Hittable>> groups;
+    std::vector<Group> groupStack;
+    HittableList sceneLights;
+    bool samplableLight = false; // Whether the last object statement made a light light sampling can pick
+
+    bool fail(const std::string& message)
+    {
+        error = message;
+        return false;
+    }
+
+    bool atEnd() const { return next >= words.size(); }
+
+    bool peekIs(const char* word) const { return !atEnd() && words[next] == word; }
+
+    bool peekIsNumber() const
+    {
+        if (atEnd())
+            return false;
+        char c = words[next][0];
+        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+    }
+
+    bool word(std::string& out, const char* what)
+    {
+        if (atEnd())
+            return fail(std::string("missing ") + what);
+        out = std::string(words[next++]);
+        return true;
+    }
+
+    bool number(double& out)
+    {
+        if (atEnd())
+            return fail("missing number");
+
+        // Words are not null terminated, so copy them out for strtod().
+        auto token = words[next];
+        char buffer[64];
+        if (token.size() >= sizeof(buffer))
+            return fail("'" + std::string(token) + "' is not a number");
+        token.copy(buffer, token.size());
+        buffer[token.size()] = '\0';
+
+        char* end;
+        out = std::strtod(buffer, &end);
+        if (*end == '/')
+        {
+            char* denominatorStart = end + 1;
+            double denominator = std::strtod(denominatorStart, &end);
+            if (end == denominatorStart || denominator == 0)
+                return fail("'" + std::string(token) + "' is not a number");
+            out /= denominator;
+        }
+        if (end == buffer || *end != '\0')
+            return fail("'" + std::string(token) + "' is not a number");
+
+        next++;
+        return true;
+    }
+
+    bool integer(int& out, int min = std::numeric_limits<int>::min(), int max = std::numeric_limits<int>::max())
+    {
+        double value;
+        if (!number(value))
+            return false;
+        std::string token(words[next - 1]);
+        if (value != std::floor(value))
+            return fail("'" + token + "' is not a whole number");
+        if (!(value >= min && value <= max))
+            return fail("'" + token + "' is out of range (" + std::to_string(min) + " to " + std::to_string(max) + ")");
+        out = int(value);
+        return true;
+    }
+
+    bool positive(double& out)
+    {
+        if (!number(out))
+            return false;
+        if (!(out > 0 && out < INF))
+            return fail("'" + std::string(words[next - 1]) + "' is not a positive number");
+        return true;
+    }
+
+    bool seed(uint64_t& out)
+    {
+        // A whole unsigned decimal number, read exactly: seeds use all 64 bits, more than a
+        // double holds.
+        if (atEnd())
+            return fail("missing seed");
+
+        std::string token(words[next]);
+        errno = 0;
+        char* end;
+        out = std::strtoull(token.c_str(), &end, 10);
+        if (token[0] < '0' || token[0] > '9' || *end != '\0' || errno != 0)
+            return fail("'" + token + "' is not a seed");
+
+        next++;
+        return true;
+    }
+
+    bool vector(glm::dvec3& out) { return number(out.x) && number(out.y) && number(out.z); }
+
+    bool texture(shared_ptr<Texture>& out)
+    {
+        // A texture name or an inline color.
+        if (peekIsNumber())
+        {
+            Color albedo;
+            if (!vector(albedo))
+                return false;
+            out = make_shared<SolidColor>(albedo);
+            return true;
+        }
+
+        std::string name;
+        if (!word(name, "texture"))
+            return false;
+        auto found = textures.find(name);
+        if (found == textures.end())
+            return fail("unknown texture '" + name + "'");
+        out = found->second;
+        return true;
+    }
+
+    bool material(shared_ptr<Material>& out)
+    {
+        std::string name;
+        if (!word(name, "material"))
+            return false;
+        auto found = materials.find(name);
+        if (found == materials.end())
+            return fail("unknown material '" + name + "'");
+        out = found->second;
+        return true;
+    }
+
+    bool group(shared_ptr<Hittable>& out)
+    {
+        std::string name;
+        if (!word(name, "group name"))
+            return false;
+        auto found = groups.find(name);
+        if (found == groups.end())
+            return fail("unknown group '" + name + "'");
+        out = found->second;
+        return true;
+    }
+
+    bool statement()
+    {
+        std::string keyword(words[next++]);
+
+        if (keyword == "camera")
+        {
+            unhashed[0] = true; // The settings are hashed on their own, wherever they are written
+            return cameraStatement();
+        }
+        if (keyword == "texture")
+            return textureStatement();
+        if (keyword == "material")
+            return materialStatement();
+
+        if (keyword == "group")
+        {
+            Group newGroup;
+            newGroup.accelerator = "list";
+            newGroup.sah = false;
+            if (!word(newGroup.name, "group name"))
+                return false;
+            if (peekIs("list") || peekIs("bvh") || peekIs("linear") || peekIs("wide"))
+                newGroup.accelerator = std::string(words[next++]);
+            if (peekIs("sah"))
+            {
+                newGroup.sah = true;
+                next++;
+            }
+            groupStack.push_back(newGroup);
+            return finish();
+        }
+
+        if (keyword == "end")
+        {
+            if (groupStack.size() <= 1)
+                return fail("end without group");
+
+            auto finished = groupStack.back();
+            groupStack.pop_back();
+            groups[finished.name] = accelerate(finished);
+            return finish();
+        }
+
+        next--;
+        shared_ptr<Hittable> object;
+        samplableLight = false;
+        if (!objectStatement(object))
+            return false;
+        groupStack.back().objects.add(object);
+        if (samplableLight && groupStack.size() == 1)
+            sceneLights.add(object);
+        return finish();
+    }
+
+    bool finish()
+    {
+        // Every word of a statement has to be used up.
+        if (!atEnd())
+            return fail("unexpected '" + std::string(words[next]) + "'");
+        return true;
+    }
+
+    shared_ptr<Hittable> accelerate(const Group& finished)
+    {
+        BvhBuildOptions options;
+        if (finished.sah)
+            options.method = BvhSplitMethod::Sah;
+
+        if (finished.accelerator == "bvh")
+            return make_shared<BvhNode>(finished.objects, options);
+        if (finished.accelerator == "linear")
+            return make_shared<LinearBvh>(finished.objects, options);
+        if (finished.accelerator == "wide")
+            return make_shared<WideBvh>(finished.objects, options);
+        return make_shared<HittableList>(finished.objects);
+    }
+
+    bool cameraStatement()
+    {
+        auto& cam = *camera;
+        while (!atEnd())
+        {
+            auto keyStart = next;
+            std::string key(words[next++]);
+            bool ok = true;
+
+            if (key == "aspect") ok = positive(cam.aspectRatio);
+            else if (key == "width") ok = integer(cam.imageWidth, 1, 1 << 16);
+            else if (key == "spp") ok = integer(cam.samplesPerPixel, 1, 1 << 24);
+            else if (key == "depth") ok = integer(cam.maxDepth, 1, 1 << 16);
+            else if (key == "background") ok = vector(cam.background);
+            else if (key == "sky") cam.useBackground = false;
+            else if (key == "fov") ok = number(cam.verticalFov);
+            else if (key == "from") ok = vector(cam.lookFrom);
+            else if (key == "at") ok = vector(cam.lookAt);
+            else if (key == "up") ok = vector(cam.vUp);
+            else if (key == "defocus") ok = number(cam.defocusAngle);
+            else if (key == "focus") ok = number(cam.focusDist);
+            else if (key == "threads") ok = integer(cam.threadCount, 0, 4096);
+            else if (key == "tile") ok = integer(cam.tileSize, 1, 1 << 16);
+            else if (key == "seed") ok = seed(cam.seed);
+            else if (key == "adaptive") cam.adaptiveSampling = true;
+            else if (key == "threshold") ok = number(cam.adaptiveThreshold);
+            else if (key == "min_samples") ok = integer(cam.adaptiveMinSamples, 2, 1 << 24);
+            else if (key == "max_samples") ok = integer(cam.adaptiveMaxSamples, 1, 1 << 24);
+            else if (key == "roulette") ok = integer(cam.rouletteDepth);
+            else if (key == "sample_lights") cam.sampleLights = true;
+            else if (key == "denoise") cam.denoise = true;
+            else if (key == "denoise_iterations") ok = integer(cam.denoiseIterations, 1, Denoiser::maxIterations);
+            else if (key == "feature_samples") ok = integer(cam.featureSamples, 1, 1 << 16);
+            else if (key == "output")
+            {
+                ok = word(cam.outputPath, "output path");
+                cam.outputFormat = imageFormatFromPath(cam.outputPath, cam.outputFormat);
+            }
+            else if (key == "aov") ok = word(cam.aovPath, "AOV path prefix");
+            else if (key == "checkpoint") ok = word(cam.checkpointPath, "checkpoint path");
+            else if (key == "checkpoint_interval") ok = number(cam.checkpointInterval);
+            else if (key == "resume") cam.resume = true;
+            else return fail("unknown camera setting '" + key + "'");
+
+            if (!ok)
+                return false;
+
+            // Settings that do not change the samples of a pixel stay out of the scene hash.
+            static const char* const unsampled[] = {"threads", "tile", "denoise", "denoise_iterations", "feature_samples",
+                                                    "output", "aov", "checkpoint", "checkpoint_interval", "resume"};
+            bool sampled = std::none_of(std::begin(unsampled), std::end(unsampled), [&](const char* name) { return key == name; });
+            std::fill(unhashed.begin() + keyStart, unhashed.begin() + next, !sampled);
+        }
+        return true;
+    }
+
+    bool textureStatement()
+    {
+        std::string name, type;
+        if (!word(name, "texture name") || !word(type, "texture type"))
+            return false;
+
+        shared_ptr<Texture> tex;
+        if (type == "solid")
+        {
+            Color albedo;
+            if (!vector(albedo))
+                return false;
+            tex = make_shared<SolidColor>(albedo);
+        }
+        else if (type == "checker")
+        {
+            double scale;
+            shared_ptr<Texture> even, odd;
+            if (!number(scale) || !texture(even) || !texture(odd))
+                return false;
+            tex = make_shared<CheckerTexture>(scale, even, odd);
+        }
+        else if (type == "image")
+        {
+            std::string file;
+            if (!word(file, "image path"))
+                return false;
+
+            auto filter = TextureFilter::Trilinear;
+            if (peekIs("nearest") || peekIs("bilinear") || peekIs("trilinear"))
+            {
+                std::string name;
+                word(name, "texture filter");
+                filter = name == "nearest" ? TextureFilter::Nearest : name == "bilinear" ? TextureFilter::Bilinear : TextureFilter::Trilinear;
+            }
+            tex = make_shared<ImageTexture>(file.c_str(), filter);
+        }
+        else if (type == "noise")
+        {
+            double scale;
+            if (!number(scale))
+                return false;
+            tex = make_shared<NoiseTexture>(scale);
+        }
+        else
+        {
+            return fail("unknown texture type '" + type + "'");
+        }
+
+        textures[name] = tex;
+        return finish();
+    }
+
+    bool materialStatement()
+    {
+        std::string name, type;
+        if (!word(name, "material name") || !word(type, "material type"))
+            return false;
+
+        shared_ptr<Material> mat;
+        shared_ptr<Texture> tex;
+        if (type == "lambertian")
+        {
+            if (!texture(tex))
+                return false;
+            mat = make_shared<Lambertian>(tex);
+        }
+        else if (type == "metal")
+        {
+            Color albedo;
+            double fuzz;
+            if (!vector(albedo) || !number(fuzz))
+                return false;
+            mat = make_shared<Metal>(albedo, fuzz);
+        }
+        else if (type == "dielectric")
+        {
+            double refractionIndex;
+            if (!number(refractionIndex))
+                return false;
+            mat = make_shared<Dielectric>(refractionIndex);
+        }
+        else if (type == "light")
+        {
+            if (!texture(tex))
+                return false;
+            mat = make_shared<DiffuseLight>(tex);
+        }
+        else if (type == "isotropic")
+        {
+            if (!texture(tex))
+                return false;
+            mat = make_shared<Isotropic>(tex);
+        }
+        else
+        {
+            return fail("unknown material type '" + type + "'");
+        }
+
+        materials[name] = mat;
+        return finish();
+    }
+
+    bool objectStatement(shared_ptr<Hittable>& object)
+    {
+        std::string type;
+        if (!word(type, "object"))
+            return false;
+
+        Point Q;
+        glm::dvec3 u, v;
+        shared_ptr<Material> mat;
+        double a, b;
+
+        if (type == "sphere")
+        {
+            Point center;
+            double radius;
+            if (!vector(center) || !number(radius) || !material(mat))
+                return false;
+
+            if (peekIs("to"))
+            {
+                next++;
+                Point center2;
+                if (!vector(center2))
+                    return false;
+                object = make_shared<Sphere>(center, center2, radius, mat);
+            }
+            else
+            {
+                object = make_shared<Sphere>(center, radius, mat);
+                samplableLight = isLight(mat);
+            }
+        }
+        else if (type == "quad" || type == "triangle")
+        {
+            if (!vector(Q) || !vector(u) || !vector(v) || !material(mat))
+                return false;
+            if (type == "quad")
+                object = make_shared<Quad>(Q, u, v, mat);
+            else
+                object = make_shared<Triangle>(Q, u, v, mat);
+            samplableLight = isLight(mat);
+        }
+        else if (type == "circle")
+        {
+            if (!vector(Q) || !vector(u) || !vector(v) || !material(mat) || !number(a))
+                return false;
+            object = make_shared<Circle>(Q, u, v, mat, a);
+        }
+        else if (type == "annulus" || type == "ellipse" || type == "parabola" || type == "hyperbola")
+        {
+            if (!vector(Q) || !vector(u) || !vector(v) || !material(mat) || !number(a) || !number(b))
+                return false;
+            if (type == "annulus")
+                object = make_shared<Annuli>(Q, u, v, mat, a, b);
+            else if (type == "ellipse")
+                object = make_shared<Ellipse>(Q, u, v, mat, a, b);
+            else if (type == "parabola")
+                object = make_shared<Parabola>(Q, u, v, mat, a, b != 0);
+            else
+                object = make_shared<Hyperbola>(Q, u, v, mat, a, b);
+        }
+        else if (type == "box")
+        {
+            Point corner0, corner1;
+            if (!vector(corner0) || !vector(corner1) || !material(mat))
+                return false;
+            object = box(corner0, corner1, mat);
+            samplableLight = isLight(mat);
+        }
+        else if (type == "mesh")
+        {
+            std::string file;
+            if (!word(file, "mesh path") || !material(mat))
+                return false;
+            object = loadCachedMesh(file, mat);
+            if (!object)
+                return fail("cannot load mesh '" + file + "'");
+        }
+        else if (type == "medium")
+        {
+            double density;
+            shared_ptr<Texture> tex;
+            shared_ptr<Hittable> boundary;
+            if (!number(density) || !texture(tex) || !objectStatement(boundary))
+                return false;
+            object = make_shared<ConstantMedium>(boundary, density, tex);
+            samplableLight = false;
+            return true; // The boundary statement has taken the transforms.
+        }
+        else if (type == "use")
+        {
+            if (!group(object))
+                return false;
+        }
+        else if (type == "instance")
+        {
+            shared_ptr<Hittable> shared;
+            glm::dmat4 transform(1.0);
+            if (!group(shared) || !instanceTransform(transform))
+                return false;
+            object = make_shared<Instance>(shared, transform);
+            return true;
+        }
+        else
+        {
+            return fail("unknown statement '" + type + "'");
+        }
+
+        return transforms(object);
+    }
+
+    static bool isLight(const shared_ptr<Material>& mat) { return dynamic_cast<const DiffuseLight*>(mat.get()) != nullptr; }
+
+    bool transforms(shared_ptr<Hittable>& object)
+    {
+        // Wraps the object in a Translate or Rotate for every transform that follows it.
+        while (!atEnd())
+        {
+            double angle;
+            glm::dvec3 offset;
+
+            if (peekIs("translate"))
+            {
+                next++;
+                if (!vector(offset))
+                    return false;
+                object = make_shared<Translate>(object, offset);
+            }
+            else if (peekIs("rotate_x") || peekIs("rotate_y") || peekIs("rotate_z"))
+            {
+                char axis = words[next++].back();
+                if (!number(angle))
+                    return false;
+                if (axis == 'x')
+                    object = make_shared<RotateX>(object, angle);
+                else if (axis == 'y')
+                    object = make_shared<RotateY>(object, angle);
+                else
+                    object = make_shared<RotateZ>(object, angle);
+            }
+            else
+            {
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool instanceTransform(glm::dmat4& transform)
+    {
+        // Composes the transforms into one matrix; each one applies after the ones before it.
+        while (!atEnd())
+        {
+            double value;
+            glm::dvec3 offset;
+            glm::dmat4 step(1.0);
+
+            if (peekIs("translate"))
+            {
+                next++;
+                if (!vector(offset))
+                    return false;
+                step = glm::translate(glm::dmat4(1.0), offset);
+            }
+            else if (peekIs("rotate_x") || peekIs("rotate_y") || peekIs("rotate_z"))
+            {
+                char axis = words[next++].back();
+                if (!number(value))
+                    return false;
+                auto axisVector = axis == 'x' ? glm::dvec3(1, 0, 0) : axis == 'y' ? glm::dvec3(0, 1, 0) : glm::dvec3(0, 0, 1);
+                step = glm::rotate(glm::dmat4(1.0), glm::radians(value), axisVector);
+            }
+            else if (peekIs("scale"))
+            {
+                next++;
+                if (!number(value))
+                    return false;
+                step = glm::scale(glm::dmat4(1.0), glm::dvec3(value, value, value));
+            }
+            else
+            {
+                break;
+            }
+
+            transform = step * transform;
+        }
+        return true;
+    }
+};
+
+inline bool loadScene(const std::string& path, HittableList& world, HittableList& lights, Camera& cam)
+{
+    SceneParser parser;
+    return parser.parse(path, world, lights, cam);
+}
+
+#endif//_SCENE_FILE_H_
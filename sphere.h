@@ -8,7 +8,7 @@ class Sphere : public Hittable
 public:
     // Stationary Sphere
     Sphere(const Point& staticCenter, double radius, shared_ptr<Material> mat)
-        : center(staticCenter, glm::dvec3(0, 0, 0)), radius(std::fmax(0, radius)), mat(mat)
+        : center(staticCenter, glm::dvec3(0, 0, 0)), radius(std::fmax(0, radius)), mat(materialTable().add(mat))
     {
         auto rvec = glm::dvec3(radius, radius, radius);
         bbox = Aabb(staticCenter - rvec, staticCenter + rvec);
@@ -16,7 +16,7 @@ public:
 
     // Moving Sphere
     Sphere(const Point& center1, const Point& center2, double radius, shared_ptr<Material> mat)
-        : center(center1, center2 - center1), radius(std::fmax(0, radius)), mat(mat)
+        : center(center1, center2 - center1), radius(std::fmax(0, radius)), mat(materialTable().add(mat))
     {
         auto rvec = glm::dvec3(radius, radius, radius);
         Aabb box1(center.at(0) - rvec, center.at(0) + rvec);
@@ -25,6 +25,68 @@ public:
     }
 
     bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+    {
+        double root;
+        if (!intersect(r, rayT, root))
+            return false;
+
+        rec.t = root;
+        rec.object = this;
+
+        return true;
+    }
+
+    bool occluded(const Ray& r, Interval rayT) const override
+    {
+        double root;
+        return intersect(r, rayT, root);
+    }
+
+    void finalizeHit(const Ray& r, HitRecord& rec) const override
+    {
+        rec.p = r.at(rec.t);
+        glm::dvec3 outwardNormal = (rec.p - center.at(r.time())) / radius;
+        rec.setFaceNormal(r, outwardNormal);
+        getSphereUv(outwardNormal, rec.u, rec.v);
+        rec.mat = mat;
+        getSphereDerivatives(outwardNormal, rec.dpdu, rec.dpdv);
+    }
+
+    double pdfValue(const Point& origin, const glm::dvec3& direction) const override
+    {
+        // Directions are sampled uniformly from the cone the sphere subtends, seen from origin.
+        // This works only for stationary spheres, and not from inside the sphere.
+        double root;
+        if (!intersect(Ray(origin, direction), Interval(0.001, INF), root))
+            return 0;
+
+        auto distanceSquared = glm::dot(center.at(0) - origin, center.at(0) - origin);
+        if (distanceSquared <= radius * radius)
+            return 0;
+
+        auto cosThetaMax = std::sqrt(1 - radius * radius / distanceSquared);
+        auto solidAngle = 2 * PI * (1 - cosThetaMax);
+
+        return 1 / solidAngle;
+    }
+
+    glm::dvec3 random(const Point& origin) const override
+    {
+        glm::dvec3 direction = center.at(0) - origin;
+        auto distanceSquared = glm::dot(direction, direction);
+        Onb uvw(direction);
+        return uvw.transform(randomToSphere(radius, distanceSquared));
+    }
+
+    Aabb boundingBox() const override { return bbox; }
+
+private:
+    Ray center;
+    double radius;
+    MaterialId mat;
+    Aabb bbox;
+
+    bool intersect(const Ray& r, const Interval& rayT, double& root) const
     {
         Point currentCenter = center.at(r.time());
         glm::dvec3 oc = currentCenter - r.origin();
@@ -39,7 +101,7 @@ public:
         auto sqrtd = std::sqrt(discriminant);
 
         // Find the nearest root that lies in the acceptable range.
-        auto root = (h - sqrtd) / a;
+        root = (h - sqrtd) / a;
         if (!rayT.surrounds(root))
         {
             root = (h + sqrtd) / a;
@@ -47,23 +109,23 @@ public:
                 return false;
         }
 
-        rec.t = root;
-        rec.p = r.at(rec.t);
-        glm::dvec3 outwardNormal = (rec.p - currentCenter) / radius;
-        rec.setFaceNormal(r, outwardNormal);
-        getSphereUv(outwardNormal, rec.u, rec.v);
-        rec.mat = mat;
-
         return true;
     }
 
-    Aabb boundingBox() const override { return bbox; }
+    static glm::dvec3 randomToSphere(double radius, double distanceSquared)
+    {
+        // A random direction within the cone around +z that a sphere of the given radius at the
+        // given squared distance subtends, with uniform density over the cone's solid angle.
+        auto r1 = randomDoubleGen();
+        auto r2 = randomDoubleGen();
+        auto z = 1 + r2 * (std::sqrt(1 - radius * radius / std::fmax(distanceSquared, radius * radius)) - 1);
 
-private:
-    Ray center;
-    double radius;
-    shared_ptr<Material> mat;
-    Aabb bbox;
+        auto phi = 2 * PI * r1;
+        auto x = std::cos(phi) * std::sqrt(1 - z * z);
+        auto y = std::sin(phi) * std::sqrt(1 - z * z);
+
+        return glm::dvec3(x, y, z);
+    }
 
     static void getSphereUv(const Point& p, double& u, double& v)
     {
@@ -80,6 +142,17 @@ private:
         u = phi / (2 * PI);
         v = theta / PI;
     }
+
+    void getSphereDerivatives(const glm::dvec3& n, glm::dvec3& dpdu, glm::dvec3& dpdv) const
+    {
+        // Derivatives of p = center + radius * n along the getSphereUv() parameterization, with
+        // n = (-cos(phi) sin(theta), -cos(theta), sin(phi) sin(theta)). At the poles, where the
+        // u direction collapses, v runs along x.
+        auto sinTheta = std::sqrt(n.x * n.x + n.z * n.z);
+        dpdu = 2 * PI * radius * glm::dvec3(n.z, 0, -n.x);
+        dpdv = sinTheta > 1e-8 ? PI * radius * glm::dvec3(-n.x * n.y / sinTheta, sinTheta, -n.y * n.z / sinTheta)
+                               : PI * radius * glm::dvec3(1, 0, 0);
+    }
 };
 
 #endif//_SPHERE_H_
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include "common.h"
+
+#include "texture_file.h"
+
+#include <string>
+
+// Converts image files to texture files (texture_file.h), which the renderer maps and reads in
+// place instead of decoding the image and building its MIP pyramid on every run.
+
+void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " IMAGE [OUTPUT]\n"
+              << "Writes the MIP-mapped, tiled texture file of IMAGE to OUTPUT (default: IMAGE with\n"
+              << "its extension replaced by .rtt). Use the .rtt file as the image of a texture.\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3 || argv[1][0] == '-')
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Timer timer;
+    std::string input = argv[1];
+    std::string output = argc == 3 ? argv[2] : input.substr(0, input.rfind('.')) + ".rtt";
+
+    RtwImage image;
+    if (!image.load(input))
+    {
+        std::cerr << "ERROR: Could not load image file '" << input << "'.\n";
+        return 1;
+    }
+
+    if (!saveTextureFile(output, image))
+        return 1;
+
+    std::clog << "Converted '" << input << "' (" << image.width() << "x" << image.height() << ") to '" << output << "' in "
+              << timer.seconds() << " s\n";
+    return 0;
+}
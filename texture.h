@@ -1,15 +1,19 @@
 #ifndef _TEXTURE_H_
 #define _TEXTURE_H_
 
+#include "mipmap.h"
 #include "perlin.h"
-#include "rtw_stb_image.h"
+#include "resource_table.h"
 
 class Texture
 {
 public:
     virtual ~Texture() = default;
 
-    virtual Color value(double u, double v, const Point& p) const = 0;
+    // footprint is the width, in u and v, of the surface area the lookup stands for (see
+    // HitRecord::footprint); textures that can prefilter average over it, (0, 0) asks for a
+    // point sample.
+    virtual Color value(double u, double v, const Point& p, const glm::dvec2& footprint) const = 0;
 };
 
 class SolidColor : public Texture
@@ -19,7 +23,7 @@ public:
 
     SolidColor(double red, double green, double blue) : SolidColor(Color(red, green, blue)) {}
 
-    Color value(double u, double v, const Point& p) const override { return albedo; }
+    Color value(double u, double v, const Point& p, const glm::dvec2& footprint) const override { return albedo; }
 
 private:
     Color albedo;
@@ -28,13 +32,13 @@ private:
 class CheckerTexture : public Texture
 {
 public:
-    CheckerTexture(double scale, shared_ptr<Texture> even, shared_ptr<Texture> odd) : invScale(1.0 / scale), even(even), odd(odd) {}
+    CheckerTexture(double scale, shared_ptr<Texture> even, shared_ptr<Texture> odd) : invScale(1.0 / scale), even(textureTable().add(even)), odd(textureTable().add(odd)) {}
 
     CheckerTexture(double scale, const Color& c1, const Color& c2)
         : CheckerTexture(scale, make_shared<SolidColor>(c1), make_shared<SolidColor>(c2))
     {}
 
-    Color value(double u, double v, const Point& p) const override
+    Color value(double u, double v, const Point& p, const glm::dvec2& footprint) const override
     {
         auto xInteger = int(std::floor(invScale * p.x));
         auto yInteger = int(std::floor(invScale * p.y));
@@ -42,40 +46,34 @@ public:
 
         bool isEven = (xInteger + yInteger + zInteger) % 2 == 0;
 
-        return isEven ? even->value(u, v, p) : odd->value(u, v, p);
+        return textureTable()[isEven ? even : odd].value(u, v, p, footprint);
     }
 
 private:
     double invScale;
-    shared_ptr<Texture> even;
-    shared_ptr<Texture> odd;
+    TextureId even;
+    TextureId odd;
 };
 
 class ImageTexture : public Texture
 {
 public:
-    ImageTexture(const char* filename) : image(filename) {}
+    // The image is shared through the texture cache and decoded on first use.
+    ImageTexture(const char* filename, TextureFilter filter = TextureFilter::Trilinear) : mipmap(filename), filter(filter) {}
 
-    Color value(double u, double v, const Point& p) const override
+    Color value(double u, double v, const Point& p, const glm::dvec2& footprint) const override
     {
         // If we have no texture data, then return solid cyan as a debugging aid.
-        if (image.height() <= 0)
+        if (mipmap.levels() == 0)
             return Color(0, 1, 1);
 
-        // Clamp input texture coordinates to [0,1] x [1,0]
-        u = Interval(0, 1).clamp(u);
-        v = 1.0 - Interval(0, 1).clamp(v); // Flip V to image coordinates
-
-        auto i = int(u * image.width());
-        auto j = int(v * image.height());
-        auto pixel = image.pixel_data(i, j);
-
-        auto colorScale = 1.0 / 255.0;
-        return Color(colorScale * pixel[0], colorScale * pixel[1], colorScale * pixel[2]);
+        // Flip V to image coordinates; the lookup clamps both to [0,1].
+        return mipmap.lookup(u, 1.0 - Interval(0, 1).clamp(v), footprint, filter);
     }
 
 private:
-    RtwImage image;
+    MipMap mipmap;
+    TextureFilter filter;
 };
 
 class NoiseTexture : public Texture
@@ -83,7 +81,7 @@ class NoiseTexture : public Texture
 public:
     NoiseTexture(double scale) : scale(scale) {}
 
-    Color value(double u, double v, const Point& p) const override
+    Color value(double u, double v, const Point& p, const glm::dvec2& footprint) const override
     {
         return Color(.5, .5, .5) * (1 + std::sin(scale * p.z + 10 * noise.turb(p, 7)));
     }
@@ -0,0 +1,444 @@
+#ifndef _TEXTURE_CACHE_H_
+#define _TEXTURE_CACHE_H_
+
+#include "rtw_stb_image.h"
+#include "texture_file.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio> // std::remove()
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// All image textures of the process share one cache. An image is opened once per file, however
+// many textures use it, and only its header is read then. Its texels, 8-bit linear RGB, are
+// kept as a MIP pyramid cut into pages of 32x32 texels, which are loaded when first touched and
+// evicted again, least recently used first, when the pages in memory exceed the budget.
+//
+// The stb formats cannot be read a page at a time, so a page fault on one of those images
+// decodes the whole image and offers all of its pages to the cache; the eviction keeps what
+// fits. An image whose pages do not all fit the budget, or that faults again after its pages
+// were evicted, is instead decoded once more into a spill file: a texture file in the temporary
+// directory, mapped and read from then on like the texture files below. So no image is decoded
+// more than twice, however tight the budget. Texture files (.rtt, texture_file.h) are mapped
+// instead, and their pages read in place; they take no part in the budget, as the OS pages them
+// in and out by itself.
+//
+// A decode briefly holds the image, its pyramid and its pages at once, outside the budget; the
+// statistics report the largest such footprint.
+
+struct TextureCacheStats
+{
+    long long hits = 0;      // Page lookups answered from memory
+    long long misses = 0;    // Page lookups that had to load the page
+    long long decodes = 0;    // Whole image decodes the misses caused
+    long long evictions = 0;  // Pages dropped to stay within the budget
+    size_t mappedImages = 0;  // Images read in place from texture files
+    size_t spilledImages = 0; // Images read in place from spill files
+    size_t residentBytes = 0;
+    size_t peakBytes = 0;
+    size_t peakDecodeBytes = 0; // Largest transient footprint of one decode, outside the budget
+    size_t budgetBytes = 0;
+};
+
+class TextureCache
+{
+public:
+    using ImageId = uint32_t;
+    static constexpr ImageId invalidImage = ~ImageId(0);
+
+    struct LevelSize
+    {
+        int width;
+        int height;
+    };
+
+    // Returns the ID of the image at path, opening it on first use. Different paths that
+    // resolve to the same file (see RtwImage::locate()) share the image. Returns invalidImage,
+    // after an error message, if there is no readable image. Like the resource tables, images
+    // are opened while the scene is built, never during rendering.
+    ImageId open(const std::string& path)
+    {
+        std::unique_lock<std::shared_mutex> guard(lock);
+
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".rtt") == 0)
+            return openTextureFile(path);
+
+        auto resolved = RtwImage::locate(path.c_str());
+        int width = 0, height = 0, components = 0;
+        if (resolved.empty() || !stbi_info(resolved.c_str(), &width, &height, &components))
+        {
+            std::cerr << "ERROR: Could not load image file '" << path << "'.\n";
+            return invalidImage;
+        }
+
+        auto found = imageIds.find(resolved);
+        if (found != imageIds.end())
+            return found->second;
+
+        auto image = std::make_unique<Image>();
+        image->path = resolved;
+        image->levels.push_back(LevelSize{width, height});
+        while (width > 1 || height > 1)
+        {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            image->levels.push_back(LevelSize{width, height});
+        }
+
+        auto id = ImageId(images.size());
+        images.push_back(std::move(image));
+        imageIds.emplace(resolved, id);
+        return id;
+    }
+
+    // Sizes of the MIP levels of an open image, level 0 first.
+    const std::vector<LevelSize>& levels(ImageId image) const { return images[image]->levels; }
+
+    Color texel(ImageId image, int level, int x, int y)
+    {
+        // Returns the texel at x, y of the level, which must lie inside it. Every thread
+        // remembers the last few pages it used, so neighbouring lookups (the four taps of a
+        // bilinear filter, say) skip the shared page table; those lookups are not counted in
+        // the statistics. A remembered page stays valid after eviction, until it is replaced.
+        struct RecentPage
+        {
+            const TextureCache* cache = nullptr;
+            uint64_t key = 0;
+            std::shared_ptr<const TexturePage> page;
+        };
+        thread_local RecentPage recent[8];
+
+        const TexturePage* texels;
+        const Image& img = *images[image];
+        const TextureFile* mapped = img.file ? img.file.get() : img.spill.load(std::memory_order_acquire);
+        if (mapped != nullptr)
+        {
+            texels = mapped->page(level, x / TexturePage::size, y / TexturePage::size);
+        }
+        else
+        {
+            auto key = pageKey(image, level, x / TexturePage::size, y / TexturePage::size);
+            auto& slot = recent[(key * 0x9e3779b97f4a7c15ULL) >> 61];
+            if (slot.cache != this || slot.key != key || !slot.page)
+            {
+                slot.cache = this;
+                slot.key = key;
+                slot.page = page(image, key);
+            }
+            texels = slot.page.get();
+        }
+
+        const unsigned char* rgb = &texels->texels[((y % TexturePage::size) * TexturePage::size + x % TexturePage::size) * 3];
+        auto colorScale = 1.0 / 255.0;
+        return Color(colorScale * rgb[0], colorScale * rgb[1], colorScale * rgb[2]);
+    }
+
+    void setBudget(size_t bytes)
+    {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        budget = bytes;
+        evictToBudget();
+    }
+
+    size_t imageCount() const
+    {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        return images.size();
+    }
+
+    TextureCacheStats stats() const
+    {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        TextureCacheStats s;
+        s.hits = hits;
+        s.misses = misses;
+        s.decodes = decodes;
+        s.evictions = evictions;
+        s.residentBytes = clockRing.size() * sizeof(TexturePage);
+        s.peakBytes = peakBytes;
+        s.peakDecodeBytes = peakDecodeBytes;
+        s.budgetBytes = budget;
+        for (const auto& image : images)
+        {
+            s.mappedImages += image->file ? 1 : 0;
+            s.spilledImages += image->spill.load(std::memory_order_relaxed) != nullptr ? 1 : 0;
+        }
+        return s;
+    }
+
+    void report() const
+    {
+        auto s = stats();
+        auto lookups = s.hits + s.misses;
+        std::clog << "Texture cache: " << imageCount() << " images (" << s.mappedImages << " mapped, " << s.spilledImages << " spilled), "
+                  << lookups << " page lookups, " << (lookups > 0 ? 100.0 * s.hits / lookups : 0.0) << "% hits, " << s.decodes
+                  << " decodes, " << s.evictions << " evictions, " << s.peakBytes / (1024.0 * 1024.0) << " MB peak of "
+                  << s.budgetBytes / (1024.0 * 1024.0) << " MB, " << s.peakDecodeBytes / (1024.0 * 1024.0) << " MB peak decode\n";
+    }
+
+private:
+    struct Image
+    {
+        std::string path;
+        std::vector<LevelSize> levels;
+        std::unique_ptr<TextureFile> file;        // Mapped pages of a texture file, or nullptr
+        std::unique_ptr<TextureFile> spillFile;   // Mapped pages of the spill file, once written
+        std::atomic<const TextureFile*> spill{nullptr}; // spillFile, published to lookups
+        std::mutex loadLock;                      // Held while the image is decoded, so it is decoded once at a time
+        int decodes = 0;                          // Times the image was decoded into the cache
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<const TexturePage> page;
+        std::atomic<bool> referenced{true}; // Used since the clock hand last passed
+    };
+
+    mutable std::shared_mutex lock;                 // Guards everything below but the counters
+    std::vector<std::unique_ptr<Image>> images;
+    std::unordered_map<std::string, ImageId> imageIds;
+    std::unordered_map<uint64_t, Entry> pages;
+    std::vector<uint64_t> clockRing;                // Keys of the resident pages
+    size_t clockHand = 0;
+    size_t budget = size_t(256) << 20;
+    size_t peakBytes = 0;
+    size_t peakDecodeBytes = 0;
+    std::atomic<long long> hits{0};
+    std::atomic<long long> misses{0};
+    long long decodes = 0;
+    long long evictions = 0;
+
+    static uint64_t pageKey(ImageId image, int level, int tileX, int tileY)
+    {
+        // 19 bits of image, 5 of level and 20 each of tile row and column. An image 65536 texels
+        // wide has 17 levels, one more than 4 bits can count.
+        return (uint64_t(image) << 45) | (uint64_t(level) << 40) | (uint64_t(tileY) << 20) | uint64_t(tileX);
+    }
+
+    ImageId openTextureFile(const std::string& path)
+    {
+        // Called with the table lock held exclusively. Texture files are opened by the path as
+        // given, without searching the image directories.
+        auto found = imageIds.find(path);
+        if (found != imageIds.end())
+            return found->second;
+
+        auto image = std::make_unique<Image>();
+        image->path = path;
+        image->file = std::make_unique<TextureFile>();
+        if (!image->file->open(path))
+        {
+            std::cerr << "ERROR: Could not load texture file '" << path << "'.\n";
+            return invalidImage;
+        }
+        for (int l = 0; l < image->file->levels(); l++)
+            image->levels.push_back(LevelSize{image->file->width(l), image->file->height(l)});
+
+        auto id = ImageId(images.size());
+        images.push_back(std::move(image));
+        imageIds.emplace(path, id);
+        return id;
+    }
+
+    std::shared_ptr<const TexturePage> page(ImageId image, uint64_t key)
+    {
+        {
+            std::shared_lock<std::shared_mutex> guard(lock);
+            auto found = pages.find(key);
+            if (found != pages.end())
+            {
+                // Clock eviction approximates LRU with one bit per page, which lookups can set
+                // under the shared lock.
+                found->second.referenced.store(true, std::memory_order_relaxed);
+                hits.fetch_add(1, std::memory_order_relaxed);
+                return found->second.page;
+            }
+        }
+
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return load(image, key);
+    }
+
+    std::shared_ptr<const TexturePage> load(ImageId image, uint64_t key)
+    {
+        // Decodes the image and builds its pyramid outside the table lock; the image's own lock
+        // keeps other threads faulting on it from decoding it again meanwhile.
+        Image& img = *images[image];
+        std::lock_guard<std::mutex> loading(img.loadLock);
+        if (auto spilled = img.spill.load(std::memory_order_acquire))
+            return mappedPage(*spilled, key);
+        {
+            std::shared_lock<std::shared_mutex> guard(lock);
+            auto found = pages.find(key);
+            if (found != pages.end())
+                return found->second.page;
+        }
+
+        size_t pageBytes = 0;
+        for (const auto& level : img.levels)
+            pageBytes += size_t((level.width + TexturePage::size - 1) / TexturePage::size) *
+                         ((level.height + TexturePage::size - 1) / TexturePage::size) * sizeof(TexturePage);
+        size_t budgetNow;
+        {
+            std::shared_lock<std::shared_mutex> guard(lock);
+            budgetNow = budget;
+        }
+
+        RtwImage decoded;
+        decoded.load(img.path);
+        auto base = img.levels[0];
+        bool valid = decoded.width() == base.width && decoded.height() == base.height;
+        if (!valid)
+            std::cerr << "ERROR: Could not decode image file '" << img.path << "'.\n";
+
+        // Decoding again means the cache could not keep the image; rather than decode it every
+        // time its pages are evicted, its pages go to a spill file read in place.
+        if (valid && (pageBytes > budgetNow || img.decodes > 0))
+        {
+            auto spilled = spill(img, image, decoded, pageBytes, budgetNow);
+            if (spilled != nullptr)
+            {
+                countDecode(size_t(base.width) * base.height * 3 * 2);
+                return mappedPage(*spilled, key);
+            }
+        }
+
+        MipLevel fine;
+        if (valid)
+            fine = mipBaseLevel(decoded);
+        else
+            fine = MipLevel{base.width, base.height, std::vector<unsigned char>(size_t(base.width) * base.height * 3, 0)};
+        auto decodeBytes = size_t(decoded.width()) * decoded.height() * 3 + fine.texels.size() + pageBytes;
+        decoded = RtwImage();
+
+        std::vector<std::pair<uint64_t, std::shared_ptr<const TexturePage>>> cut;
+        for (int l = 0; l < int(img.levels.size()); l++)
+        {
+            if (l > 0)
+                fine = downsampleMipLevel(fine);
+            cutPages(image, l, fine, cut);
+        }
+        fine = MipLevel();
+        img.decodes++;
+
+        std::shared_ptr<const TexturePage> wanted;
+        std::unique_lock<std::shared_mutex> guard(lock);
+        decodes++;
+        peakDecodeBytes = std::max(peakDecodeBytes, decodeBytes);
+        for (auto& page : cut)
+        {
+            if (page.first == key)
+                wanted = page.second;
+
+            auto inserted = pages.try_emplace(page.first);
+            if (!inserted.second)
+                continue;
+
+            inserted.first->second.page = std::move(page.second);
+            inserted.first->second.referenced.store(page.first == key, std::memory_order_relaxed);
+            clockRing.push_back(page.first);
+            peakBytes = std::max(peakBytes, clockRing.size() * sizeof(TexturePage));
+            evictToBudget();
+        }
+        return wanted;
+    }
+
+    const TextureFile* spill(Image& img, ImageId image, const RtwImage& decoded, size_t pageBytes, size_t budgetNow)
+    {
+        // Called with the image's lock held. Writes the image's pages to a texture file in the
+        // temporary directory and maps it. The file is removed as soon as it is mapped; the
+        // mapping keeps its pages. Returns nullptr, after a warning, if that fails.
+        std::error_code error;
+        auto directory = std::filesystem::temp_directory_path(error);
+        auto stamp = mixBits(uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()) ^ image);
+        auto path = (directory / ("rt-texture-" + std::to_string(stamp) + ".rtt")).string();
+
+        auto file = std::make_unique<TextureFile>();
+        bool ok = !error && saveTextureFile(path, decoded) && file->open(path);
+        std::remove(path.c_str());
+        if (!ok)
+        {
+            std::cerr << "WARNING: Could not write a spill file for image '" << img.path << "'; it is decoded again whenever its pages were evicted.\n";
+            return nullptr;
+        }
+
+        if (pageBytes > budgetNow)
+            std::cerr << "WARNING: Image '" << img.path << "' needs " << pageBytes / (1024.0 * 1024.0) << " MB of pages, more than the "
+                      << budgetNow / (1024.0 * 1024.0) << " MB texture cache budget; its pages are read from a spill file instead.\n";
+
+        img.spillFile = std::move(file);
+        img.spill.store(img.spillFile.get(), std::memory_order_release);
+        return img.spillFile.get();
+    }
+
+    void countDecode(size_t decodeBytes)
+    {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        decodes++;
+        peakDecodeBytes = std::max(peakDecodeBytes, decodeBytes);
+    }
+
+    static std::shared_ptr<const TexturePage> mappedPage(const TextureFile& file, uint64_t key)
+    {
+        // A page of a mapped file, in a pointer that does not own it: the mapping lives as long
+        // as the cache.
+        int level = int((key >> 40) & 31);
+        int tileY = int((key >> 20) & 0xfffff);
+        int tileX = int(key & 0xfffff);
+        return std::shared_ptr<const TexturePage>(std::shared_ptr<const TexturePage>(), file.page(level, tileX, tileY));
+    }
+
+    static void cutPages(ImageId image, int level, const MipLevel& mip, std::vector<std::pair<uint64_t, std::shared_ptr<const TexturePage>>>& out)
+    {
+        int tilesX = (mip.width + TexturePage::size - 1) / TexturePage::size;
+        int tilesY = (mip.height + TexturePage::size - 1) / TexturePage::size;
+        for (int ty = 0; ty < tilesY; ty++)
+        {
+            for (int tx = 0; tx < tilesX; tx++)
+            {
+                auto page = std::make_shared<TexturePage>();
+                cutPage(mip, tx, ty, *page);
+                out.emplace_back(pageKey(image, level, tx, ty), std::move(page));
+            }
+        }
+    }
+
+    void evictToBudget()
+    {
+        // Called with the table lock held exclusively. The hand sweeps the ring, giving pages
+        // that were used since its last pass a second chance.
+        while (!clockRing.empty() && clockRing.size() * sizeof(TexturePage) > budget)
+        {
+            if (clockHand >= clockRing.size())
+                clockHand = 0;
+
+            auto found = pages.find(clockRing[clockHand]);
+            if (found->second.referenced.exchange(false, std::memory_order_relaxed))
+            {
+                clockHand++;
+                continue;
+            }
+
+            pages.erase(found);
+            clockRing[clockHand] = clockRing.back();
+            clockRing.pop_back();
+            evictions++;
+        }
+    }
+};
+
+inline TextureCache& textureCache()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+#endif//_TEXTURE_CACHE_H_
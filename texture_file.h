@@ -0,0 +1,251 @@
+#ifndef _TEXTURE_FILE_H_
+#define _TEXTURE_FILE_H_
+
+#include "mapped_file.h"
+#include "rtw_stb_image.h"
+
+#include <algorithm> // std::min(), std::max(), std::copy_n()
+#include <cstdint>
+#include <cstdio> // std::rename(), std::remove()
+#include <cstring> // std::memcpy()
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Image textures are kept as 8-bit linear RGB MIP pyramids cut into pages of 32x32 texels, both
+// in memory (texture_cache.h) and in .rtt texture files. A texture file holds the pages of
+// every level ready to use: once the file is mapped the cache reads them in place, with nothing
+// to decode, filter or allocate, and the OS pages in only the pages the render touches. The
+// texconv tool writes them. Like mesh caches, texture files are in the byte order of the
+// machine that wrote them.
+
+struct MipLevel
+{
+    int width;
+    int height;
+    std::vector<unsigned char> texels; // RGB, rows from top to bottom
+};
+
+inline MipLevel downsampleMipLevel(const MipLevel& fine)
+{
+    // Box filters 2x2 blocks; the last row or column of an odd sized level is folded into the
+    // block before it. Halves the size, rounded down, but to no less than one texel.
+    MipLevel coarse{std::max(1, fine.width / 2), std::max(1, fine.height / 2), {}};
+    coarse.texels.resize(size_t(coarse.width) * coarse.height * 3);
+
+    for (int y = 0; y < coarse.height; y++)
+    {
+        int y0 = 2 * y;
+        int y1 = y == coarse.height - 1 ? fine.height : y0 + 2;
+        for (int x = 0; x < coarse.width; x++)
+        {
+            int x0 = 2 * x;
+            int x1 = x == coarse.width - 1 ? fine.width : x0 + 2;
+
+            int sum[3] = {0, 0, 0};
+            for (int fy = y0; fy < y1; fy++)
+            {
+                for (int fx = x0; fx < x1; fx++)
+                {
+                    const unsigned char* texel = &fine.texels[(size_t(fy) * fine.width + fx) * 3];
+                    sum[0] += texel[0];
+                    sum[1] += texel[1];
+                    sum[2] += texel[2];
+                }
+            }
+
+            int count = (y1 - y0) * (x1 - x0);
+            unsigned char* out = &coarse.texels[(size_t(y) * coarse.width + x) * 3];
+            for (int c = 0; c < 3; c++)
+                out[c] = static_cast<unsigned char>((sum[c] + count / 2) / count);
+        }
+    }
+    return coarse;
+}
+
+struct TexturePage
+{
+    static constexpr int size = 32; // Edge length in texels
+
+    unsigned char texels[size * size * 3]; // RGB, rows from top to bottom; edge pages are padded
+};
+
+inline MipLevel mipBaseLevel(const RtwImage& image)
+{
+    // Copies the decoded image into level 0 of a pyramid.
+    MipLevel base{image.width(), image.height(), std::vector<unsigned char>(size_t(image.width()) * image.height() * 3)};
+    for (int y = 0; y < base.height; y++)
+        std::copy_n(image.pixel_data(0, y), size_t(base.width) * 3, &base.texels[size_t(y) * base.width * 3]);
+    return base;
+}
+
+inline void cutPage(const MipLevel& mip, int tileX, int tileY, TexturePage& page)
+{
+    // Copies one page out of the level, repeating the last row and column past its edges.
+    for (int y = 0; y < TexturePage::size; y++)
+    {
+        int sy = std::min(tileY * TexturePage::size + y, mip.height - 1);
+        for (int x = 0; x < TexturePage::size; x++)
+        {
+            int sx = std::min(tileX * TexturePage::size + x, mip.width - 1);
+            std::copy_n(&mip.texels[(size_t(sy) * mip.width + sx) * 3], 3, &page.texels[(y * TexturePage::size + x) * 3]);
+        }
+    }
+}
+
+struct TextureFileLevel
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t tilesX = 0;
+    uint32_t tilesY = 0;
+    uint64_t offset = 0; // Of the first page, from the start of the file; pages follow row by row
+};
+
+struct TextureFileHeader
+{
+    static constexpr int maxLevels = 32;
+
+    uint32_t magic = 0x54545452; // "RTTT"
+    uint32_t version = 1;
+    uint32_t byteOrder = 0x01020304;
+    uint32_t pageSize = TexturePage::size;
+    uint32_t levelCount = 0;
+    uint32_t pad = 0;
+    uint64_t fileSize = 0;
+    TextureFileLevel levels[maxLevels];
+
+    bool matches(const TextureFileHeader& expected) const
+    {
+        return magic == expected.magic && version == expected.version && byteOrder == expected.byteOrder && pageSize == expected.pageSize;
+    }
+};
+
+class TextureFile
+{
+    // A mapped texture file. The pages it hands out point into the mapping.
+
+public:
+    bool open(const std::string& path)
+    {
+        // Maps the file and checks that it is a texture file of this version and byte order,
+        // and that its levels halve down to one texel with every page inside the file.
+        if (!file.open(path))
+            return false;
+
+        if (file.size() < sizeof(TextureFileHeader))
+            return close();
+
+        std::memcpy(&header, file.data(), sizeof(TextureFileHeader));
+        if (!header.matches(TextureFileHeader()) || header.fileSize != file.size() || header.levelCount == 0 ||
+            header.levelCount > uint32_t(TextureFileHeader::maxLevels))
+            return close();
+
+        for (uint32_t l = 0; l < header.levelCount; l++)
+        {
+            const auto& level = header.levels[l];
+            auto expectedWidth = l == 0 ? level.width : std::max(1u, header.levels[l - 1].width / 2);
+            auto expectedHeight = l == 0 ? level.height : std::max(1u, header.levels[l - 1].height / 2);
+            auto pagesBytes = uint64_t(level.tilesX) * level.tilesY * sizeof(TexturePage);
+
+            if (level.width == 0 || level.height == 0 || level.width != expectedWidth || level.height != expectedHeight ||
+                level.tilesX != (level.width + TexturePage::size - 1) / TexturePage::size ||
+                level.tilesY != (level.height + TexturePage::size - 1) / TexturePage::size || level.offset % 64 != 0 ||
+                level.offset > header.fileSize || pagesBytes > header.fileSize - level.offset)
+                return close();
+        }
+
+        auto last = header.levels[header.levelCount - 1];
+        if (last.width != 1 || last.height != 1)
+            return close();
+
+        return true;
+    }
+
+    int levels() const { return int(header.levelCount); }
+    int width(int level) const { return int(header.levels[level].width); }
+    int height(int level) const { return int(header.levels[level].height); }
+
+    const TexturePage* page(int level, int tileX, int tileY) const
+    {
+        const auto& l = header.levels[level];
+        return reinterpret_cast<const TexturePage*>(file.data() + l.offset) + size_t(tileY) * l.tilesX + tileX;
+    }
+
+private:
+    MappedFile file;
+    TextureFileHeader header;
+
+    bool close()
+    {
+        file.close();
+        return false;
+    }
+};
+
+inline bool saveTextureFile(const std::string& path, const RtwImage& image)
+{
+    // Builds the pyramid of the image and writes its pages to a temporary file, renamed over
+    // path once it is complete. The pages are 3 KB, a multiple of 64 bytes, so with the first
+    // page of every level on a 64 byte boundary all of them are.
+    if (image.width() <= 0 || image.height() <= 0)
+        return false;
+
+    TextureFileHeader header;
+    uint64_t offset = (sizeof(TextureFileHeader) + 63) & ~uint64_t(63);
+    for (uint32_t width = image.width(), height = image.height();; width = std::max(1u, width / 2), height = std::max(1u, height / 2))
+    {
+        auto& level = header.levels[header.levelCount++];
+        level.width = width;
+        level.height = height;
+        level.tilesX = (width + TexturePage::size - 1) / TexturePage::size;
+        level.tilesY = (height + TexturePage::size - 1) / TexturePage::size;
+        level.offset = offset;
+        offset += uint64_t(level.tilesX) * level.tilesY * sizeof(TexturePage);
+
+        if ((width == 1 && height == 1) || header.levelCount == uint32_t(TextureFileHeader::maxLevels))
+            break;
+    }
+    header.fileSize = offset;
+
+    auto tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        const char zeros[64] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(TextureFileHeader));
+        file.write(zeros, std::streamsize(header.levels[0].offset - sizeof(TextureFileHeader)));
+
+        auto mip = mipBaseLevel(image);
+        TexturePage page;
+        for (uint32_t l = 0; l < header.levelCount; l++)
+        {
+            if (l > 0)
+                mip = downsampleMipLevel(mip);
+
+            for (uint32_t ty = 0; ty < header.levels[l].tilesY; ty++)
+            {
+                for (uint32_t tx = 0; tx < header.levels[l].tilesX; tx++)
+                {
+                    cutPage(mip, int(tx), int(ty), page);
+                    file.write(reinterpret_cast<const char*>(&page), sizeof(TexturePage));
+                }
+            }
+        }
+
+        if (!file.flush())
+        {
+            std::cerr << "ERROR: Could not write texture file '" << tempPath << "'.\n";
+            return false;
+        }
+    }
+
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "ERROR: Could not replace texture file '" << path << "'.\n";
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+#endif//_TEXTURE_FILE_H_
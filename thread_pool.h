@@ -0,0 +1,106 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <algorithm> // std::min()
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    ThreadPool(int threadCount = 0) : threadCount(threadCount > 0 ? threadCount : hardwareThreadCount()) {}
+
+    int size() const { return threadCount; }
+
+    static int hardwareThreadCount()
+    {
+        // hardware_concurrency() is allowed to return 0 when the value is not computable.
+        auto count = std::thread::hardware_concurrency();
+        return count > 0 ? int(count) : 1;
+    }
+
+    void parallelFor(size_t taskCount, const std::function<void(size_t task, int worker)>& task)
+    {
+        // Runs task(index, worker) once for every index in [0, taskCount) and returns when all of
+        // them are done. The indices are dealt out to per-worker queues in contiguous chunks, so
+        // neighbouring tasks start on the same thread. A worker pops from the front of its own
+        // queue and, once that runs dry, steals from the back of the other workers' queues.
+
+        int workerCount = int(std::min<size_t>(threadCount, taskCount));
+        if (workerCount <= 1)
+        {
+            for (size_t index = 0; index < taskCount; index++)
+                task(index, 0);
+            return;
+        }
+
+        std::vector<WorkQueue> queues(workerCount);
+        for (int worker = 0; worker < workerCount; worker++)
+        {
+            size_t first = taskCount * worker / workerCount;
+            size_t last = taskCount * (worker + 1) / workerCount;
+            for (size_t index = first; index < last; index++)
+                queues[worker].tasks.push_back(index);
+        }
+
+        auto work = [&](int worker) {
+            size_t index;
+            while (popLocal(queues[worker], index) || steal(queues, worker, index))
+                task(index, worker);
+        };
+
+        // The calling thread takes part as worker 0.
+        std::vector<std::thread> threads;
+        threads.reserve(workerCount - 1);
+        for (int worker = 1; worker < workerCount; worker++)
+            threads.emplace_back(work, worker);
+
+        work(0);
+
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    int threadCount;
+
+    static bool popLocal(WorkQueue& queue, size_t& index)
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty())
+            return false;
+
+        index = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    static bool steal(std::vector<WorkQueue>& queues, int thief, size_t& index)
+    {
+        // No task is ever added after the start, so finding every queue empty means we're done.
+        int count = int(queues.size());
+        for (int offset = 1; offset < count; offset++)
+        {
+            auto& victim = queues[(thief + offset) % count];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (victim.tasks.empty())
+                continue;
+
+            index = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+        return false;
+    }
+};
+
+#endif//_THREAD_POOL_H_
@@ -0,0 +1,277 @@
+#ifndef _TRIANGLE_MESH_H_
+#define _TRIANGLE_MESH_H_
+
+#include "hittable.h"
+#include "wide_bvh.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MeshView
+{
+    // Read-only pointers to indexed triangle geometry, wherever it is stored: in a MeshData or
+    // in a mapped cache file. Optional arrays are null when the mesh doesn't have them.
+
+    const float* positions = nullptr;        // x, y, z per vertex
+    const float* normals = nullptr;          // x, y, z per vertex
+    const float* uvs = nullptr;              // u, v per vertex
+    const uint32_t* indices = nullptr;       // Three vertex indices per triangle
+    const uint16_t* triangleSlots = nullptr; // Material slot per triangle
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
+
+    Point position(uint32_t vertex) const { return Point(positions[3 * vertex], positions[3 * vertex + 1], positions[3 * vertex + 2]); }
+
+    Aabb triangleBounds(size_t triangle) const
+    {
+        auto a = position(indices[3 * triangle]);
+        auto b = position(indices[3 * triangle + 1]);
+        auto c = position(indices[3 * triangle + 2]);
+        return Aabb(Aabb(a, b), Aabb(a, c));
+    }
+};
+
+struct MeshMaterialSlot
+{
+    // A material named by the mesh file, and the diffuse texture file it refers to, if any.
+    std::string name;
+    std::string texture;
+};
+
+struct MeshData
+{
+    // Indexed triangle geometry. Vertex attributes are stored once in flat float arrays and
+    // triangles refer to them by index, so a vertex shared by six triangles is stored once
+    // instead of six times.
+
+    std::vector<float> positions;                // x, y, z per vertex
+    std::vector<float> normals;                  // x, y, z per vertex, or empty
+    std::vector<float> uvs;                      // u, v per vertex, or empty
+    std::vector<uint32_t> indices;               // Three vertex indices per triangle
+    std::vector<uint16_t> triangleSlots;         // Index into materialSlots per triangle, or empty
+    std::vector<MeshMaterialSlot> materialSlots; // Materials named by the mesh file
+    std::vector<std::string> materialLibraries;  // Files the slots' textures were read from (OBJ mtllib)
+
+    size_t vertexCount() const { return positions.size() / 3; }
+    size_t triangleCount() const { return indices.size() / 3; }
+
+    MeshView view() const
+    {
+        MeshView view;
+        view.positions = positions.data();
+        view.normals = normals.empty() ? nullptr : normals.data();
+        view.uvs = uvs.empty() ? nullptr : uvs.data();
+        view.indices = indices.data();
+        view.triangleSlots = triangleSlots.empty() ? nullptr : triangleSlots.data();
+        view.vertexCount = vertexCount();
+        view.triangleCount = triangleCount();
+        return view;
+    }
+};
+
+class TriangleMesh : public Hittable
+{
+    // A triangle mesh with its own BVH over the triangles. The geometry is shared, so several
+    // meshes (e.g. with different materials) or instances can use one copy of it. Triangles use
+    // the material of their slot; slots past the end of the material list use the first one.
+
+public:
+    TriangleMesh(shared_ptr<const MeshData> data, shared_ptr<Material> mat, const BvhBuildOptions& options = defaultBuildOptions())
+        : TriangleMesh(data, std::vector<shared_ptr<Material>>{mat}, options)
+    {}
+
+    TriangleMesh(shared_ptr<const MeshData> data, const std::vector<shared_ptr<Material>>& slotMaterials, const BvhBuildOptions& options = defaultBuildOptions())
+        : storage(data), mesh(data->view()), materials(materialIds(slotMaterials))
+    {
+        std::vector<Aabb> triangleBounds;
+        triangleBounds.reserve(mesh.triangleCount);
+        for (size_t i = 0; i < mesh.triangleCount; i++)
+            triangleBounds.push_back(mesh.triangleBounds(i));
+
+        Timer buildTimer;
+        tree.build(triangleBounds, options);
+        bbox = tree.boundingBox();
+
+        std::clog << "Triangle mesh with " << mesh.triangleCount << " triangles, BVH built in " << buildTimer.seconds() << " s\n";
+    }
+
+    // Geometry and a prebuilt tree that live in memory kept alive by storage, e.g. a mapped
+    // cache file. Nothing is copied or built.
+    TriangleMesh(shared_ptr<const void> storage, const MeshView& mesh, const WideBvhTree& tree, const std::vector<shared_ptr<Material>>& slotMaterials)
+        : storage(storage), mesh(mesh), materials(materialIds(slotMaterials)), tree(tree), bbox(tree.boundingBox())
+    {}
+
+    static BvhBuildOptions defaultBuildOptions()
+    {
+        BvhBuildOptions options;
+        options.method = BvhSplitMethod::Sah;
+        return options;
+    }
+
+    const MeshView& meshView() const { return mesh; }
+    const WideBvhTree& bvh() const { return tree; }
+
+    bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+    {
+        // Traversal only keeps the closest triangle and its barycentric coordinates; the rest
+        // of the hit record is filled in by finalizeHit().
+
+        uint32_t closest = 0;
+        double closestT = 0, closestB1 = 0, closestB2 = 0;
+
+        bool hitAnything = tree.traverse(r, rayT, [&](uint32_t triangle, Interval& t) {
+            double hitT, b1, b2;
+            if (!intersect(triangle, r, t, hitT, b1, b2))
+                return false;
+
+            t.max = hitT;
+            closest = triangle;
+            closestT = hitT;
+            closestB1 = b1;
+            closestB2 = b2;
+            return true;
+        });
+
+        if (!hitAnything)
+            return false;
+
+        rec.t = closestT;
+        rec.u = closestB1;
+        rec.v = closestB2;
+        rec.object = this;
+        rec.primitive = closest;
+        return true;
+    }
+
+    bool occluded(const Ray& r, Interval rayT) const override
+    {
+        return tree.traverse<true>(r, rayT, [&](uint32_t triangle, Interval& t) {
+            double hitT, b1, b2;
+            return intersect(triangle, r, t, hitT, b1, b2);
+        });
+    }
+
+    void finalizeHit(const Ray& r, HitRecord& rec) const override
+    {
+        setHitRecord(rec.primitive, r, rec.t, rec.u, rec.v, rec);
+    }
+
+    Aabb boundingBox() const override { return bbox; }
+
+private:
+    shared_ptr<const void> storage; // Owner of the memory mesh points into
+    MeshView mesh;
+    std::vector<MaterialId> materials;
+    WideBvhTree tree;
+    Aabb bbox;
+
+    static std::vector<MaterialId> materialIds(const std::vector<shared_ptr<Material>>& slotMaterials)
+    {
+        std::vector<MaterialId> ids;
+        for (const auto& mat : slotMaterials)
+            ids.push_back(materialTable().add(mat));
+        return ids;
+    }
+
+    bool intersect(uint32_t triangle, const Ray& r, const Interval& rayT, double& t, double& b1, double& b2) const
+    {
+        // Möller-Trumbore: solves origin + t * dir = (1 - b1 - b2) * a + b1 * b + b2 * c for t
+        // and the barycentric coordinates b1, b2 with Cramer's rule.
+
+        const uint32_t* index = &mesh.indices[3 * triangle];
+        auto a = mesh.position(index[0]);
+        auto edge1 = mesh.position(index[1]) - a;
+        auto edge2 = mesh.position(index[2]) - a;
+
+        auto p = glm::cross(r.direction(), edge2);
+        auto det = glm::dot(edge1, p);
+
+        // No hit if the ray is parallel to the triangle, or the triangle is degenerate.
+        if (std::fabs(det) < 1e-12)
+            return false;
+
+        auto invDet = 1.0 / det;
+        auto s = r.origin() - a;
+        b1 = glm::dot(s, p) * invDet;
+        if (b1 < 0 || b1 > 1)
+            return false;
+
+        auto q = glm::cross(s, edge1);
+        b2 = glm::dot(r.direction(), q) * invDet;
+        if (b2 < 0 || b1 + b2 > 1)
+            return false;
+
+        t = glm::dot(edge2, q) * invDet;
+        return rayT.surrounds(t);
+    }
+
+    void setHitRecord(uint32_t triangle, const Ray& r, double t, double b1, double b2, HitRecord& rec) const
+    {
+        const uint32_t* index = &mesh.indices[3 * triangle];
+        auto a = mesh.position(index[0]);
+        auto b = mesh.position(index[1]);
+        auto c = mesh.position(index[2]);
+        auto b0 = 1 - b1 - b2;
+
+        rec.t = t;
+        rec.p = b0 * a + b1 * b + b2 * c;
+        size_t slot = mesh.triangleSlots != nullptr ? mesh.triangleSlots[triangle] : 0;
+        rec.mat = materials[slot < materials.size() ? slot : 0];
+
+        // The face side comes from the geometric normal; interpolated vertex normals, when the
+        // mesh has them, only bend the shading normal on that side. Exporters do not agree on
+        // winding, so the vertex normals may point either way relative to the geometric normal;
+        // they are flipped to the side the ray arrives from rather than trusted.
+        auto geometricNormal = glm::normalize(glm::cross(b - a, c - a));
+        rec.setFaceNormal(r, geometricNormal);
+
+        if (mesh.normals != nullptr)
+        {
+            auto vertexNormal = [&](uint32_t vertex) {
+                const float* n = &mesh.normals[3 * vertex];
+                return glm::dvec3(n[0], n[1], n[2]);
+            };
+            auto shadingNormal = b0 * vertexNormal(index[0]) + b1 * vertexNormal(index[1]) + b2 * vertexNormal(index[2]);
+            if (glm::dot(shadingNormal, shadingNormal) > 0)
+            {
+                shadingNormal = glm::normalize(shadingNormal);
+                rec.normal = glm::dot(shadingNormal, rec.normal) < 0 ? -shadingNormal : shadingNormal;
+            }
+        }
+
+        if (mesh.uvs != nullptr)
+        {
+            const float* uv0 = &mesh.uvs[2 * index[0]];
+            const float* uv1 = &mesh.uvs[2 * index[1]];
+            const float* uv2 = &mesh.uvs[2 * index[2]];
+            rec.u = b0 * uv0[0] + b1 * uv1[0] + b2 * uv2[0];
+            rec.v = b0 * uv0[1] + b1 * uv1[1] + b2 * uv2[1];
+
+            // Solve the edges for the position change per unit of u and v, unless the
+            // triangle's UVs are degenerate.
+            double du1 = uv1[0] - uv0[0], dv1 = uv1[1] - uv0[1];
+            double du2 = uv2[0] - uv0[0], dv2 = uv2[1] - uv0[1];
+            auto det = du1 * dv2 - dv1 * du2;
+            if (std::fabs(det) > 1e-12)
+            {
+                rec.dpdu = (dv2 * (b - a) - dv1 * (c - a)) / det;
+                rec.dpdv = (du1 * (c - a) - du2 * (b - a)) / det;
+            }
+            else
+            {
+                rec.dpdu = glm::dvec3(0, 0, 0);
+                rec.dpdv = glm::dvec3(0, 0, 0);
+            }
+        }
+        else
+        {
+            rec.u = b1;
+            rec.v = b2;
+            rec.dpdu = b - a;
+            rec.dpdv = c - a;
+        }
+    }
+};
+
+#endif//_TRIANGLE_MESH_H_
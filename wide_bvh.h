@@ -0,0 +1,381 @@
+#ifndef _WIDE_BVH_H_
+#define _WIDE_BVH_H_
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
+
+#include <algorithm> // std::max()
+#include <cmath>     // std::abs(), std::nextafter()
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RT_WIDE_BVH_SSE 1
+#include <xmmintrin.h>
+#endif
+
+struct alignas(64) WideBvhNode
+{
+    // Four children with their boxes stored as separate float arrays per bound (structure of
+    // arrays), so one SIMD slab test covers all four. 128 bytes, two cache lines.
+
+    static const int width = 4;
+    static const uint32_t emptySlot = 0xffffffff;
+
+    float minX[width], minY[width], minZ[width];
+    float maxX[width], maxY[width], maxZ[width];
+    uint32_t child[width]; // Interior child: node index. Leaf child: first primitive index entry
+    uint16_t count[width]; // Leaf child: number of primitives. 0 for interior children
+};
+
+class WideBvhTree
+{
+    // 4-wide hierarchy collapsed from a binary LinearBvhTree. Like the binary tree it only knows
+    // primitive indices; the owner intersects primitives through the callback of traverse().
+
+public:
+    void build(const std::vector<Aabb>& primitiveBounds, const BvhBuildOptions& options = BvhBuildOptions())
+    {
+        LinearBvhTree binary;
+        binary.build(primitiveBounds, options);
+
+        nodes.clear();
+        primitiveIndices = binary.primitiveIndexArray();
+        if (binary.nodeCount() > 0)
+            collapse(binary.nodeArray(), 0);
+
+        externalNodes = nullptr;
+        externalIndices = nullptr;
+        externalNodeCount = externalIndexCount = 0;
+    }
+
+    void attach(const WideBvhNode* nodeData, size_t nodeCount, const uint32_t* indexData, size_t indexCount)
+    {
+        // Uses a tree built earlier that lives in memory owned by someone else, e.g. a mapped
+        // cache file, without copying it. The memory has to outlive the tree.
+
+        nodes.clear();
+        primitiveIndices.clear();
+        externalNodes = nodeData;
+        externalNodeCount = nodeCount;
+        externalIndices = indexData;
+        externalIndexCount = indexCount;
+    }
+
+    const WideBvhNode* nodeData() const { return externalNodes != nullptr ? externalNodes : nodes.data(); }
+    const uint32_t* primitiveIndexData() const { return externalIndices != nullptr ? externalIndices : primitiveIndices.data(); }
+    size_t primitiveIndexCount() const { return externalIndices != nullptr ? externalIndexCount : primitiveIndices.size(); }
+
+    template <bool anyHit = false, typename IntersectFn>
+    bool traverse(const Ray& r, Interval rayT, IntersectFn&& intersect) const
+    {
+        // Tests all children of a node in one go and pushes the ones the ray enters, farthest
+        // first, so the nearest is popped next. Entries whose entry distance lies beyond the
+        // closest hit found in the meantime are dropped when popped. intersect(primitiveIndex,
+        // rayT) and anyHit work as for LinearBvhTree::traverse().
+
+        if (nodeCount() == 0)
+            return false;
+
+        const WideBvhNode* treeNodes = nodeData();
+        const uint32_t* treeIndices = primitiveIndexData();
+        RayConstants ray(r);
+
+        struct Entry
+        {
+            float tNear;
+            uint32_t index;
+            uint32_t count;
+        };
+
+        Entry stack[3 * LinearBvhTree::stackSize + WideBvhNode::width];
+        int stackTop = 0;
+        stack[stackTop++] = {float(rayT.min), 0, 0};
+        bool hitAnything = false;
+
+        while (stackTop > 0)
+        {
+            Entry entry = stack[--stackTop];
+            if (entry.tNear > rayT.max)
+                continue;
+
+            if (entry.count > 0)
+            {
+                for (uint32_t i = 0; i < entry.count; i++)
+                {
+                    if (intersect(treeIndices[entry.index + i], rayT))
+                    {
+                        if (anyHit)
+                            return true;
+                        hitAnything = true;
+                    }
+                }
+                continue;
+            }
+
+            const WideBvhNode& node = treeNodes[entry.index];
+            float tNear[WideBvhNode::width];
+            int mask = hitChildren(node, ray, rayT, tNear);
+
+            // Gather the hit children and insertion sort them by descending entry distance.
+            int first = stackTop;
+            for (int c = 0; c < WideBvhNode::width; c++)
+            {
+                if (!(mask & (1 << c)))
+                    continue;
+
+                Entry child = {tNear[c], node.child[c], node.count[c]};
+                int k = stackTop++;
+                while (k > first && stack[k - 1].tNear < child.tNear)
+                {
+                    stack[k] = stack[k - 1];
+                    k--;
+                }
+                stack[k] = child;
+            }
+        }
+
+        return hitAnything;
+    }
+
+    Aabb boundingBox() const
+    {
+        if (nodeCount() == 0)
+            return Aabb::empty;
+
+        Aabb bbox = Aabb::empty;
+        const auto& root = nodeData()[0];
+        for (int c = 0; c < WideBvhNode::width; c++)
+            if (root.child[c] != WideBvhNode::emptySlot)
+                bbox = Aabb(bbox, Aabb(Point(root.minX[c], root.minY[c], root.minZ[c]), Point(root.maxX[c], root.maxY[c], root.maxZ[c])));
+        return bbox;
+    }
+
+    size_t nodeCount() const { return externalNodes != nullptr ? externalNodeCount : nodes.size(); }
+
+private:
+    std::vector<WideBvhNode> nodes;
+    std::vector<uint32_t> primitiveIndices;
+
+    // Set by attach() instead of the two arrays above.
+    const WideBvhNode* externalNodes = nullptr;
+    const uint32_t* externalIndices = nullptr;
+    size_t externalNodeCount = 0;
+    size_t externalIndexCount = 0;
+
+    struct RayConstants
+    {
+        // The ray's origin and reciprocal direction in float, and for each axis whether the ray
+        // meets the upper bound first. Rounding the origin shifts the slab distances of an axis by
+        // up to its rounding error times the reciprocal direction; originError is the largest such
+        // shift, rounded up, by which the slab test widens every interval. Far from the scene
+        // origin it can be much larger than the relative error farScale covers.
+        float origin[3];
+        float invDir[3];
+        bool negative[3];
+        float originError = 0;
+
+        RayConstants(const Ray& r)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                origin[axis] = float(r.origin()[axis]);
+                invDir[axis] = float(r.invDirection()[axis]);
+                negative[axis] = r.dirIsNegative(axis);
+
+                // Axes the ray runs parallel to have infinite slab distances either way.
+                double error = std::abs(r.origin()[axis] - double(origin[axis])) * std::abs(r.invDirection()[axis]);
+                if (error > 0 && error < INF)
+                    originError = std::max(originError, std::nextafter(float(error), INFINITY));
+            }
+        }
+    };
+
+    // Float slab distances are off by a few ulps; widening the far distance by 1 + 2 * gamma(3)
+    // keeps the test conservative (Ize, "Robust BVH Ray Traversal", 2013).
+    static constexpr float farScale = 1.0f + 2.0f * (3 * 0.5f * 1.1920929e-7f) / (1 - 3 * 0.5f * 1.1920929e-7f);
+
+    static int hitChildren(const WideBvhNode& node, const RayConstants& ray, const Interval& rayT, float* tNear)
+    {
+        // Slab test of the ray against the four child boxes. Returns a bit mask of the children
+        // hit and their entry distances. The near and far planes are picked by direction sign,
+        // and every min/max is ordered so that a NaN from 0 * inf drops out instead of spreading.
+
+        const float* nearX = ray.negative[0] ? node.maxX : node.minX;
+        const float* farX = ray.negative[0] ? node.minX : node.maxX;
+        const float* nearY = ray.negative[1] ? node.maxY : node.minY;
+        const float* farY = ray.negative[1] ? node.minY : node.maxY;
+        const float* nearZ = ray.negative[2] ? node.maxZ : node.minZ;
+        const float* farZ = ray.negative[2] ? node.minZ : node.maxZ;
+
+#ifdef RT_WIDE_BVH_SSE
+        auto ox = _mm_set1_ps(ray.origin[0]), oy = _mm_set1_ps(ray.origin[1]), oz = _mm_set1_ps(ray.origin[2]);
+        auto ix = _mm_set1_ps(ray.invDir[0]), iy = _mm_set1_ps(ray.invDir[1]), iz = _mm_set1_ps(ray.invDir[2]);
+
+        // _mm_max_ps/_mm_min_ps return their second operand when either one is NaN.
+        auto tMin = _mm_set1_ps(float(rayT.min));
+        tMin = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearX), ox), ix), tMin);
+        tMin = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearY), oy), iy), tMin);
+        tMin = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearZ), oz), iz), tMin);
+
+        auto tMax = _mm_set1_ps(float(rayT.max));
+        tMax = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(farX), ox), ix), tMax);
+        tMax = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(farY), oy), iy), tMax);
+        tMax = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(farZ), oz), iz), tMax);
+        auto error = _mm_set1_ps(ray.originError);
+        tMin = _mm_sub_ps(tMin, error);
+        tMax = _mm_add_ps(_mm_mul_ps(tMax, _mm_set1_ps(farScale)), error);
+
+        _mm_storeu_ps(tNear, tMin);
+        return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax));
+#else
+        auto maxOf = [](float a, float b) { return a > b ? a : b; }; // b when a is NaN
+        auto minOf = [](float a, float b) { return a < b ? a : b; };
+
+        int mask = 0;
+        for (int c = 0; c < WideBvhNode::width; c++)
+        {
+            auto tMin = float(rayT.min);
+            tMin = maxOf((nearX[c] - ray.origin[0]) * ray.invDir[0], tMin);
+            tMin = maxOf((nearY[c] - ray.origin[1]) * ray.invDir[1], tMin);
+            tMin = maxOf((nearZ[c] - ray.origin[2]) * ray.invDir[2], tMin);
+
+            auto tMax = float(rayT.max);
+            tMax = minOf((farX[c] - ray.origin[0]) * ray.invDir[0], tMax);
+            tMax = minOf((farY[c] - ray.origin[1]) * ray.invDir[1], tMax);
+            tMax = minOf((farZ[c] - ray.origin[2]) * ray.invDir[2], tMax);
+
+            tMin -= ray.originError;
+            tMax = tMax * farScale + ray.originError;
+
+            tNear[c] = tMin;
+            mask |= (tMin <= tMax) << c;
+        }
+        return mask;
+#endif
+    }
+
+    uint32_t collapse(const std::vector<LinearBvhNode>& binary, uint32_t binaryIndex)
+    {
+        // Creates the wide node for binary node binaryIndex and its descendants. Starting from
+        // the node's own children, the interior child with the largest box keeps getting replaced
+        // by its two children until there are four children or only leaves are left.
+
+        auto wideIndex = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        std::vector<uint32_t> children;
+        if (binary[binaryIndex].isLeaf())
+        {
+            children.push_back(binaryIndex);
+        }
+        else
+        {
+            children.push_back(binaryIndex + 1);
+            children.push_back(binary[binaryIndex].offset);
+        }
+
+        while (children.size() < size_t(WideBvhNode::width))
+        {
+            int largest = -1;
+            double largestArea = -1;
+            for (size_t c = 0; c < children.size(); c++)
+            {
+                const auto& node = binary[children[c]];
+                if (node.isLeaf())
+                    continue;
+
+                auto area = Aabb(Point(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]),
+                                 Point(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]))
+                                .surfaceArea();
+                if (area > largestArea)
+                {
+                    largestArea = area;
+                    largest = int(c);
+                }
+            }
+
+            if (largest < 0)
+                break;
+
+            auto expanded = children[largest];
+            children[largest] = expanded + 1;
+            children.push_back(binary[expanded].offset);
+        }
+
+        // Empty slots get an inverted box that no ray can hit.
+        for (int c = 0; c < WideBvhNode::width; c++)
+        {
+            auto& node = nodes[wideIndex];
+            node.minX[c] = node.minY[c] = node.minZ[c] = INFINITY;
+            node.maxX[c] = node.maxY[c] = node.maxZ[c] = -INFINITY;
+            node.child[c] = WideBvhNode::emptySlot;
+            node.count[c] = 0;
+        }
+
+        for (size_t c = 0; c < children.size(); c++)
+        {
+            const auto& source = binary[children[c]];
+            uint32_t child = source.offset;
+            if (!source.isLeaf())
+                child = collapse(binary, children[c]);
+
+            // collapse() grows the node array, so look the node up again.
+            auto& node = nodes[wideIndex];
+            node.minX[c] = source.boundsMin[0];
+            node.minY[c] = source.boundsMin[1];
+            node.minZ[c] = source.boundsMin[2];
+            node.maxX[c] = source.boundsMax[0];
+            node.maxY[c] = source.boundsMax[1];
+            node.maxZ[c] = source.boundsMax[2];
+            node.child[c] = child;
+            node.count[c] = source.primitiveCount;
+        }
+
+        return wideIndex;
+    }
+};
+
+class WideBvh : public Hittable
+{
+public:
+    WideBvh(const HittableList& list, const BvhBuildOptions& options = BvhBuildOptions()) : objects(list.objects)
+    {
+        std::vector<Aabb> objectBounds;
+        objectBounds.reserve(objects.size());
+        for (const auto& object : objects)
+            objectBounds.push_back(object->boundingBox());
+
+        Timer buildTimer;
+        tree.build(objectBounds, options);
+        bbox = tree.boundingBox();
+
+        std::clog << "Wide BVH over " << objects.size() << " objects, " << tree.nodeCount() << " nodes ("
+                  << (options.method == BvhSplitMethod::Sah ? "SAH" : "median") << " split) built in " << buildTimer.seconds() << " s\n";
+    }
+
+    bool hit(const Ray& r, Interval rayT, HitRecord& rec) const override
+    {
+        return tree.traverse(r, rayT, [&](uint32_t index, Interval& t) {
+            if (!objects[index]->hit(r, t, rec))
+                return false;
+            t.max = rec.t;
+            return true;
+        });
+    }
+
+    bool occluded(const Ray& r, Interval rayT) const override
+    {
+        return tree.traverse<true>(r, rayT, [&](uint32_t index, Interval& t) { return objects[index]->occluded(r, t); });
+    }
+
+    Aabb boundingBox() const override { return bbox; }
+
+private:
+    std::vector<shared_ptr<Hittable>> objects;
+    WideBvhTree tree;
+    Aabb bbox;
+};
+
+#endif//_WIDE_BVH_H_